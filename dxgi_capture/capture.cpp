@@ -1,4 +1,5 @@
 #include "capture.h"
+#include "convert.h"
 
 capture::capture() {
 }
@@ -106,6 +107,7 @@ bool capture::initialize() {
 }
 
 void capture::release() {
+    RESET_OBJECT(_staging);
     RESET_OBJECT(_desktop_dup);
     RESET_OBJECT(_device_ctx);
     RESET_OBJECT(_device);
@@ -119,19 +121,24 @@ color *capture::pixel(int x, int y) {
     return &black;
 }
 
-bool capture::update(uint8_t *buffer, int32_t &size, int time) {
+bool capture::acquire(const rect &roi, const mutable_image_view &out, int factor, bool &fresh) {
+    fresh = false;
+    if (roi.x < 0 || roi.y < 0 || roi.width <= 0 || roi.height <= 0 || roi.x + roi.width > _width || roi.y + roi.height > _height) {
+        return false;
+    }
     if (!attach_thread()) {
         return false;
     }
 
-    size = 0;
-
     IDXGIResource *dxgi_resource = NULL;
     DXGI_OUTDUPL_FRAME_INFO frame_info;
     _desktop_dup->ReleaseFrame();
     HRESULT hr = _desktop_dup->AcquireNextFrame(1000, &frame_info, &dxgi_resource);
     if (FAILED(hr)) {
         if (hr == DXGI_ERROR_WAIT_TIMEOUT) {
+            // nothing was presented, the bitmap is unchanged
+            _hints.clear();
+            _hints_valid = !_hints_lost;
             return true;
         }
         release();
@@ -139,6 +146,8 @@ bool capture::update(uint8_t *buffer, int32_t &size, int time) {
         return false;
     }
 
+    collect_hints(frame_info);
+
     //
     // query next frame staging buffer
     //
@@ -150,69 +159,155 @@ bool capture::update(uint8_t *buffer, int32_t &size, int time) {
     }
 
     //
-    // copy old description
+    // one staging texture for all frames, made again only when the desktop changes size or format
     //
     D3D11_TEXTURE2D_DESC frame_desc;
     desktop_image->GetDesc(&frame_desc);
-
-    //
-    // create a new staging buffer for fill frame image
-    //
-    ID3D11Texture2D *new_desktop_image = NULL;
-    frame_desc.Usage = D3D11_USAGE_STAGING;
-    frame_desc.CPUAccessFlags = D3D11_CPU_ACCESS_READ;
-    frame_desc.BindFlags = 0;
-    frame_desc.MiscFlags = 0;
-    frame_desc.MipLevels = 1;
-    frame_desc.ArraySize = 1;
-    frame_desc.SampleDesc.Count = 1;
-    hr = _device->CreateTexture2D(&frame_desc, NULL, &new_desktop_image);
-    if (FAILED(hr)) {
+    if (UINT(roi.x + roi.width) > frame_desc.Width || UINT(roi.y + roi.height) > frame_desc.Height) {
+        // the mode changed under us, initialize() has not caught up yet
         RESET_OBJECT(desktop_image);
         _desktop_dup->ReleaseFrame();
         return false;
     }
+    if (_staging != nullptr) {
+        D3D11_TEXTURE2D_DESC staging_desc;
+        _staging->GetDesc(&staging_desc);
+        if (staging_desc.Width != frame_desc.Width || staging_desc.Height != frame_desc.Height || staging_desc.Format != frame_desc.Format) {
+            RESET_OBJECT(_staging);
+        }
+    }
+    if (_staging == nullptr) {
+        frame_desc.Usage = D3D11_USAGE_STAGING;
+        frame_desc.CPUAccessFlags = D3D11_CPU_ACCESS_READ;
+        frame_desc.BindFlags = 0;
+        frame_desc.MiscFlags = 0;
+        frame_desc.MipLevels = 1;
+        frame_desc.ArraySize = 1;
+        frame_desc.SampleDesc.Count = 1;
+        hr = _device->CreateTexture2D(&frame_desc, NULL, &_staging);
+        if (FAILED(hr)) {
+            RESET_OBJECT(desktop_image);
+            _desktop_dup->ReleaseFrame();
+            return false;
+        }
+    }
 
     //
-    // copy next staging buffer to new staging buffer
+    // copy the region to the top left of the staging texture, only it crosses to system memory
     //
-    _device_ctx->CopyResource(new_desktop_image, desktop_image);
+    if (roi.width == _width && roi.height == _height) {
+        _device_ctx->CopyResource(_staging, desktop_image);
+    } else {
+        D3D11_BOX box = {UINT(roi.x), UINT(roi.y), 0, UINT(roi.x + roi.width), UINT(roi.y + roi.height), 1};
+        _device_ctx->CopySubresourceRegion(_staging, 0, 0, 0, 0, desktop_image, 0, &box);
+    }
 
     RESET_OBJECT(desktop_image);
     _desktop_dup->ReleaseFrame();
 
     //
-    // create staging buffer for map bits
+    // convert straight out of the mapped rows, they are RowPitch bytes apart, not width * 4
     //
-    IDXGISurface *staging_surface = NULL;
-    hr = new_desktop_image->QueryInterface(__uuidof(IDXGISurface), (void **)(&staging_surface));
-    RESET_OBJECT(new_desktop_image);
+    D3D11_MAPPED_SUBRESOURCE mapped;
+    hr = _device_ctx->Map(_staging, 0, D3D11_MAP_READ, 0, &mapped);
     if (FAILED(hr)) {
         return false;
     }
-    DXGI_SURFACE_DESC staging_surface_desc;
 
-    // BGRA8
-    staging_surface->GetDesc(&staging_surface_desc);
-
-    //
-    // copy bits to user space
-    //
-    DXGI_MAPPED_RECT mapped_rect;
-    hr = staging_surface->Map(&mapped_rect, DXGI_MAP_READ);
-    int image_size = _width * _height * 4;
-    if (SUCCEEDED(hr)) {
-        size = image_size;
-        std::copy(mapped_rect.pBits, mapped_rect.pBits + image_size, buffer);
-        staging_surface->Unmap();
-    } else
+    auto region = image_view(static_cast<const uint8_t *>(mapped.pData), roi.width, roi.height, int(mapped.RowPitch));
+    auto copied = convert::copy(region, rect{0, 0, roi.width, roi.height}, out, factor);
+    _device_ctx->Unmap(_staging, 0);
+    if (!copied) {
         return false;
+    }
+
+    fresh = true;
+    return true;
+}
 
-    RESET_OBJECT(staging_surface);
+void capture::collect_hints(const DXGI_OUTDUPL_FRAME_INFO &frame_info) {
+    _hints.clear();
+    _hints_valid = false;
+
+    // the bitmap missed a frame, its changes are in no rect list
+    if (_hints_lost) {
+        _hints_lost = false;
+        return;
+    }
+
+    if (frame_info.TotalMetadataBufferSize == 0) {
+        // only the pointer moved when nothing was presented, otherwise DXGI can't tell
+        _hints_valid = frame_info.LastPresentTime.QuadPart == 0;
+        return;
+    }
+
+    if (_metadata.size() < frame_info.TotalMetadataBufferSize) {
+        _metadata.resize(frame_info.TotalMetadataBufferSize);
+    }
 
-    return SUCCEEDED(hr);
+    // move rects first, dirty rects in the rest of the buffer
+    UINT move_bytes = 0;
+    auto moves = reinterpret_cast<DXGI_OUTDUPL_MOVE_RECT *>(_metadata.data());
+    if (FAILED(_desktop_dup->GetFrameMoveRects(UINT(_metadata.size()), moves, &move_bytes))) {
+        return;
+    }
+
+    UINT dirty_bytes = 0;
+    auto dirty = reinterpret_cast<RECT *>(_metadata.data() + move_bytes);
+    if (FAILED(_desktop_dup->GetFrameDirtyRects(UINT(_metadata.size()) - move_bytes, dirty, &dirty_bytes))) {
+        return;
+    }
+
+    // a move changes its destination, the source area shows up as a dirty rect
+    for (UINT i = 0; i < move_bytes / sizeof(DXGI_OUTDUPL_MOVE_RECT); ++i) {
+        auto &to = moves[i].DestinationRect;
+        _hints.push_back(rect{to.left, to.top, to.right - to.left, to.bottom - to.top});
+    }
+    for (UINT i = 0; i < dirty_bytes / sizeof(RECT); ++i) {
+        _hints.push_back(rect{dirty[i].left, dirty[i].top, dirty[i].right - dirty[i].left, dirty[i].bottom - dirty[i].top});
+    }
+    _hints_valid = true;
+}
+
+bool capture::change_hints(std::vector<rect> &hints) {
+    if (!_hints_valid) {
+        return false;
+    }
+    hints.insert(hints.end(), _hints.begin(), _hints.end());
+    return true;
 }
 
 bool capture::update() {
-    return update(_data.data(), _image_size, 0);
+    bool fresh;
+    if (!acquire(rect{0, 0, _width, _height}, mutable_image_view(_data.data(), _width, _height, _width * 4), 1, fresh)) {
+        // the frame DXGI reported changes for never reached _data
+        _hints_lost = true;
+        return false;
+    }
+    return true;
+}
+
+bool capture::update_into(uint8_t *bits, int pitch, int width, int height) {
+    if (width != _width || height != _height) {
+        return false;
+    }
+    return update_roi(rect{0, 0, width, height}, mutable_image_view(bits, width, height, pitch), 1);
+}
+
+bool capture::update_roi(const rect &roi, const mutable_image_view &out, int factor) {
+    // bad arguments are refused before a frame is taken, they lose neither the frame nor its hints
+    if (!convert::can_copy(_width, _height, roi, out, factor)) {
+        return false;
+    }
+    bool fresh;
+    if (!acquire(roi, out, factor, fresh)) {
+        _hints_lost = true;
+        return false;
+    }
+    if (fresh) {
+        // the frame went to `out`, _data still holds an older one the rects don't describe
+        _hints_valid = false;
+        _hints_lost = true;
+    }
+    return fresh;
 }
\ No newline at end of file
@@ -7,65 +7,45 @@
 #include "D3D11.h"
 #include "DXGI1_2.h"
 #include <iostream>
+
+#include "frame_source.h"
 #pragma comment(lib, "D3D11.lib")
 #pragma comment(lib, "DXGI.lib")
 
 #define RESET_OBJECT(obj) { if(obj) obj->Release(); obj = NULL; }
 
-struct color {
-	unsigned char b, g, r, a;
-public:
-
-	color operator=(const color& that) {
-		r = that.r;
-		g = that.g;
-		b = that.b;
-		a = that.a;
-		return *this;
-	}
-
-	color(uint32_t col) {
-		r = col >> 24;
-		g = (col >> 16) & 0xFF;
-		b = (col >> 8) & 0xFF;
-		a = col & 0xFF;
-	}
-
-	color() {
-		r = 0;
-		g = 0;
-		b = 0;
-		a = 0;
-	}
-
-	color(int r, int g, int b) {
-		this->r = r;
-		this->g = g;
-		this->b = b;
-		this->a = 255;
-	}
-};
-
-class capture
+class capture : public frame_source
 {
 public:
 	capture();
 	~capture();
 
-	bool update();
+	bool update() override;
 
 	bool initialize();
 	void release();
 
-	int width() { return _width; }
-	int height() { return _height; }
+	int width() override { return _width; }
+	int height() override { return _height; }
+	int pitch() override { return _width * 4; }
 
 	color * pixel(int x, int y);
 
-	const uint8_t* bitmap() { return _data.data(); }
+	const uint8_t* bitmap() override { return _data.data(); }
+
+	// these map the frame straight into the caller's buffer, bitmap() keeps the last update() frame
+	bool update_into(uint8_t* bits, int pitch, int width, int height) override;
+	bool update_roi(const rect& roi, const mutable_image_view& out, int factor = 1) override;
+
+	// DXGI's dirty and move rects for the last update(), relative to the frame before it;
+	// false when a frame went to update_into / update_roi in between, bitmap() skipped it
+	bool change_hints(std::vector<rect>& hints) override;
 
 private:
-	bool update(uint8_t* buffer, int32_t& size, int time);
+	// copies `roi` of the next frame into `out` (see convert::copy); `fresh`
+	// is false when nothing was presented in time
+	bool acquire(const rect& roi, const mutable_image_view& out, int factor, bool& fresh);
+	void collect_hints(const DXGI_OUTDUPL_FRAME_INFO& frame_info);
 
 	bool attach_thread()
 	{
@@ -92,9 +72,15 @@ private:
 	ID3D11Device* _device = nullptr;
 	ID3D11DeviceContext* _device_ctx = nullptr;
 	IDXGIOutputDuplication* _desktop_dup = nullptr;
+	ID3D11Texture2D* _staging = nullptr; // CPU readable copy of the frame, reused every frame
 
 	std::vector<uint8_t> _data;
 	int _width = 0;
 	int _height = 0;
 	int _image_size = 0;
+
+	std::vector<uint8_t> _metadata; // move + dirty rect buffer, reused across frames
+	std::vector<rect> _hints;
+	bool _hints_valid = false;
+	bool _hints_lost = false;
 };
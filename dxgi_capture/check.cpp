@@ -0,0 +1,179 @@
+// Checks for the parts of the capture pipeline that run without DXGI, fed
+// by synthetic_source. Run them under the sanitizers:
+//
+//   g++ -std=c++17 -g -fsanitize=address,undefined -Wno-interference-size check.cpp synthetic_source.cpp convert.cpp
+//       frame_codec.cpp frame_recorder.cpp frame_pipeline.cpp ../zipper/zipper.cpp -o check -pthread && ./check
+//
+// and once more with -fsanitize=thread for the pipeline and the pool.
+//
+// Prints the failed checks and exits with 1 if there are any. Writes its
+// recordings to the current directory and removes them again.
+
+#include "frame_pipeline.h"
+#include "frame_recorder.h"
+#include "synthetic_source.h"
+#include "../thread_pool/thread_pool.hpp"
+
+#include <cstdio>
+#include <cstring>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace {
+    int failures = 0;
+
+    void check(bool ok, const char *what, int line) {
+        if (!ok) {
+            std::fprintf(stderr, "line %d: %s\n", line, what);
+            ++failures;
+        }
+    }
+
+#define CHECK(expr) check((expr), #expr, __LINE__)
+
+    std::vector<uint8_t> packed(frame_source &source) {
+        std::vector<uint8_t> frame(size_t(source.width()) * source.height() * 4);
+        for (int y = 0; y < source.height(); ++y)
+            std::memcpy(&frame[size_t(y) * source.width() * 4], source.bitmap() + size_t(y) * source.pitch(), size_t(source.width()) * 4);
+        return frame;
+    }
+
+    bool shows(frame_source &source, const std::vector<uint8_t> &frame) {
+        return frame.size() == size_t(source.width()) * source.height() * 4 && packed(source) == frame;
+    }
+
+    // 57 frames, keyframes every 10, a size change at 30 and a save at 44
+    // that starts a new segment at 45
+    void recorder_round_trip(ThreadPool *pool) {
+        const char *file_name = "check_recording.zip";
+        std::vector<std::vector<uint8_t>> frames;
+        {
+            frame_recorder recorder(pool, 10, 4);
+            synthetic_source large(320, 200, 0);
+            synthetic_source small(160, 100, 0, synthetic_source::pattern::scrolling, 160 * 4 + 32);
+            auto start = std::chrono::steady_clock::now();
+            for (int i = 0; i < 57; ++i) {
+                frame_source &source = i >= 30 && i < 40 ? static_cast<frame_source &>(small) : large;
+                source.update();
+                frames.push_back(packed(source));
+                recorder.record(image_view(source.bitmap(), source.width(), source.height(), source.pitch()), start + std::chrono::milliseconds(16 * i));
+                if (i == 44)
+                    CHECK(recorder.save(file_name) == zipper::Error::Success);
+            }
+            CHECK(recorder.save(file_name) == zipper::Error::Success);
+        }
+
+        frame_player player;
+        CHECK(player.open(file_name) == zipper::Error::Success);
+        CHECK(player.frame_count() == 57);
+        for (int i = 0; i < 57; ++i) {
+            if (!player.update() || !shows(player, frames[size_t(i)]) || player.time().count() != 16000 * i) {
+                check(false, "playback matches the recorded frames", __LINE__);
+                break;
+            }
+        }
+        CHECK(!player.update());
+
+        const std::pair<int, int> seeks[] = {{0, 0}, {5, 0}, {19, 10}, {33, 30}, {41, 40}, {47, 45}, {56, 55}};
+        for (auto &seek : seeks) {
+            CHECK(player.seek(uint64_t(seek.first)) == uint64_t(seek.second));
+            while (player.position() <= uint64_t(seek.first) && player.update()) {
+            }
+            CHECK(shows(player, frames[size_t(seek.first)]));
+        }
+        CHECK(player.seek(std::chrono::microseconds(16000 * 25 + 5)) == 20);
+
+        // a failed open keeps the recording that was open
+        player.seek(uint64_t(0));
+        CHECK(player.open("check_missing.zip") != zipper::Error::Success);
+        CHECK(player.frame_count() == 57);
+        CHECK(player.update() && shows(player, frames[0]));
+
+        // and a good one starts over with the new recording
+        CHECK(player.open(file_name) == zipper::Error::Success);
+        CHECK(player.position() == 0);
+        CHECK(player.update() && shows(player, frames[0]));
+
+        std::remove(file_name);
+    }
+
+    bool matches(const frame_pipeline::frame &frame, const std::vector<uint8_t> &expected) {
+        if (frame.bits == nullptr || size_t(frame.width) * frame.height * 4 != expected.size())
+            return false;
+        for (int y = 0; y < frame.height; ++y) {
+            if (std::memcmp(frame.bits + size_t(y) * frame.pitch, &expected[size_t(y) * frame.width * 4], size_t(frame.width) * 4) != 0)
+                return false;
+        }
+        return true;
+    }
+
+    // unpaced scrolling frames: the source always has a new one, so the
+    // capture thread keeps the pool drained and the consumer is the bottleneck
+    void pipeline_hand_off() {
+        constexpr int width = 64, height = 32, period = width / 8; // the scroll repeats every `period` frames
+        std::vector<std::vector<uint8_t>> expected;
+        synthetic_source reference(width, height, 0, synthetic_source::pattern::scrolling);
+        for (int i = 0; i < period; ++i) {
+            reference.update();
+            expected.push_back(packed(reference));
+        }
+
+        synthetic_source source(width, height, 0, synthetic_source::pattern::scrolling);
+        frame_pipeline pipeline(source, 3);
+        pipeline.start();
+
+        // acquire() hands out every frame in order, sequence n is the source's frame n + 1
+        frame_pipeline::frame frame;
+        for (uint64_t n = 0; n < 500; ++n) {
+            if (!pipeline.acquire(frame, std::chrono::seconds(2)) || frame.sequence != n || !matches(frame, expected[n % period])) {
+                check(false, "acquire returns every frame in order", __LINE__);
+                break;
+            }
+            pipeline.release(frame);
+        }
+
+        // acquire_latest may skip frames but never goes back
+        uint64_t last = 0;
+        for (int i = 0; i < 200; ++i) {
+            CHECK(pipeline.acquire_latest(frame, std::chrono::seconds(2)) && frame.sequence > last);
+            CHECK(matches(frame, expected[frame.sequence % period]));
+            last = frame.sequence;
+            pipeline.release(frame);
+        }
+
+        // holding every buffer: the frames stay as they were, and the
+        // stretch without buffers counts once however many polls it lasts
+        frame_pipeline::frame held[3];
+        for (auto &h : held)
+            CHECK(pipeline.acquire(h, std::chrono::seconds(2)));
+        auto starved = pipeline.starved();
+        std::this_thread::sleep_for(std::chrono::milliseconds(50));
+        CHECK(pipeline.starved() <= starved + 1);
+        for (auto &h : held) {
+            CHECK(matches(h, expected[h.sequence % period]));
+            pipeline.release(h);
+        }
+        CHECK(pipeline.acquire(frame, std::chrono::seconds(2)));
+        pipeline.release(frame);
+
+        pipeline.stop();
+        CHECK(pipeline.produced() >= 704);
+    }
+}
+
+int main() {
+    recorder_round_trip(nullptr);
+    {
+        ThreadPool pool(2);
+        recorder_round_trip(&pool);
+    }
+    pipeline_hand_off();
+
+    if (failures != 0) {
+        std::fprintf(stderr, "%d checks failed\n", failures);
+        return 1;
+    }
+    std::printf("ok\n");
+    return 0;
+}
@@ -0,0 +1,238 @@
+#include "convert.h"
+#include "frame_source.h"
+#include "simd.h"
+
+#include <algorithm>
+#include <cstring>
+
+namespace {
+    // BT.601 luma in 1/128ths: 0.114 B + 0.587 G + 0.299 R, small enough
+    // that B*wb + G*wg of a pixel still fits a signed 16 bit lane
+    constexpr int weight_b = 15;
+    constexpr int weight_g = 75;
+    constexpr int weight_r = 38;
+
+    uint8_t gray_pixel(const uint8_t *p) {
+        return uint8_t((p[0] * weight_b + p[1] * weight_g + p[2] * weight_r + 64) >> 7);
+    }
+
+#if defined(FRAME_SSE2)
+    // 4 BGRA pixels to 4 luma values, one per 32 bit lane
+    inline __m128i gray4(__m128i pixels) {
+        auto zero = _mm_setzero_si128();
+        auto weights = _mm_setr_epi16(weight_b, weight_g, weight_r, 0, weight_b, weight_g, weight_r, 0);
+        // (B*wb + G*wg, R*wr) per pixel, then both halves added
+        auto lo = _mm_madd_epi16(_mm_unpacklo_epi8(pixels, zero), weights);
+        auto hi = _mm_madd_epi16(_mm_unpackhi_epi8(pixels, zero), weights);
+        auto sum = _mm_madd_epi16(_mm_packs_epi32(lo, hi), _mm_set1_epi16(1));
+        return _mm_srli_epi32(_mm_add_epi32(sum, _mm_set1_epi32(64)), 7);
+    }
+
+    // sum of the channels of the two BGRA pixels in each half, as 16 bit lanes
+    inline __m128i widen_add(__m128i a, __m128i b, __m128i &hi) {
+        auto zero = _mm_setzero_si128();
+        hi = _mm_add_epi16(_mm_unpackhi_epi8(a, zero), _mm_unpackhi_epi8(b, zero));
+        return _mm_add_epi16(_mm_unpacklo_epi8(a, zero), _mm_unpacklo_epi8(b, zero));
+    }
+#endif
+}
+
+void convert::bgra_to_gray(const uint8_t *bgra, uint8_t *gray, int pixels) {
+    int x = 0;
+#if defined(FRAME_AVX2)
+    {
+        auto zero = _mm256_setzero_si256();
+        auto weights = _mm256_setr_epi16(weight_b, weight_g, weight_r, 0, weight_b, weight_g, weight_r, 0,
+                                         weight_b, weight_g, weight_r, 0, weight_b, weight_g, weight_r, 0);
+        auto ones = _mm256_set1_epi16(1);
+        auto round = _mm256_set1_epi32(64);
+        auto order = _mm256_setr_epi32(0, 4, 1, 5, 2, 6, 3, 7);
+        auto gray8 = [&](__m256i pixels) {
+            auto lo = _mm256_madd_epi16(_mm256_unpacklo_epi8(pixels, zero), weights);
+            auto hi = _mm256_madd_epi16(_mm256_unpackhi_epi8(pixels, zero), weights);
+            auto sum = _mm256_madd_epi16(_mm256_packs_epi32(lo, hi), ones);
+            return _mm256_srli_epi32(_mm256_add_epi32(sum, round), 7);
+        };
+        for (; x + 16 <= pixels; x += 16) {
+            auto a = gray8(_mm256_loadu_si256(reinterpret_cast<const __m256i *>(bgra + size_t(x) * 4)));
+            auto b = gray8(_mm256_loadu_si256(reinterpret_cast<const __m256i *>(bgra + size_t(x) * 4 + 32)));
+            // packing works per 128 bit lane, the permute puts the 4 byte groups back in order
+            auto packed = _mm256_packus_epi16(_mm256_packs_epi32(a, b), zero);
+            packed = _mm256_permutevar8x32_epi32(packed, order);
+            _mm_storeu_si128(reinterpret_cast<__m128i *>(gray + x), _mm256_castsi256_si128(packed));
+        }
+    }
+#endif
+#if defined(FRAME_SSE2)
+    for (; x + 8 <= pixels; x += 8) {
+        auto a = gray4(_mm_loadu_si128(reinterpret_cast<const __m128i *>(bgra + size_t(x) * 4)));
+        auto b = gray4(_mm_loadu_si128(reinterpret_cast<const __m128i *>(bgra + size_t(x) * 4 + 16)));
+        auto packed = _mm_packus_epi16(_mm_packs_epi32(a, b), _mm_setzero_si128());
+        _mm_storel_epi64(reinterpret_cast<__m128i *>(gray + x), packed);
+    }
+#endif
+    for (; x < pixels; ++x) {
+        gray[x] = gray_pixel(bgra + size_t(x) * 4);
+    }
+}
+
+void convert::bgra_to_rgb24(const uint8_t *bgra, uint8_t *rgb, int pixels) {
+    int x = 0;
+#if defined(FRAME_SSSE3)
+    {
+        // 4 pixels to 12 bytes, the top 4 bytes zeroed
+        auto shuffle = _mm_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1);
+        for (; x + 16 <= pixels; x += 16) {
+            auto source = reinterpret_cast<const __m128i *>(bgra + size_t(x) * 4);
+            auto a = _mm_shuffle_epi8(_mm_loadu_si128(source + 0), shuffle);
+            auto b = _mm_shuffle_epi8(_mm_loadu_si128(source + 1), shuffle);
+            auto c = _mm_shuffle_epi8(_mm_loadu_si128(source + 2), shuffle);
+            auto d = _mm_shuffle_epi8(_mm_loadu_si128(source + 3), shuffle);
+            // 48 bytes in three full stores
+            auto out = reinterpret_cast<__m128i *>(rgb + size_t(x) * 3);
+            _mm_storeu_si128(out + 0, _mm_or_si128(a, _mm_slli_si128(b, 12)));
+            _mm_storeu_si128(out + 1, _mm_or_si128(_mm_srli_si128(b, 4), _mm_slli_si128(c, 8)));
+            _mm_storeu_si128(out + 2, _mm_or_si128(_mm_srli_si128(c, 8), _mm_slli_si128(d, 4)));
+        }
+    }
+#endif
+    for (; x < pixels; ++x) {
+        rgb[x * 3 + 0] = bgra[x * 4 + 2];
+        rgb[x * 3 + 1] = bgra[x * 4 + 1];
+        rgb[x * 3 + 2] = bgra[x * 4 + 0];
+    }
+}
+
+void convert::shrink2(const uint8_t *bgra, size_t pitch, uint8_t *out, int out_pixels) {
+    auto top = bgra, bottom = bgra + pitch;
+    int x = 0;
+#if defined(FRAME_SSE2)
+    {
+        auto round = _mm_set1_epi16(2);
+        // 4 source pixels of two rows to 2 averaged pixels, as 16 bit lanes
+        auto average = [&](__m128i a, __m128i b) {
+            __m128i hi;
+            auto lo = widen_add(a, b, hi);
+            auto sum = _mm_add_epi16(_mm_unpacklo_epi64(lo, hi), _mm_unpackhi_epi64(lo, hi));
+            return _mm_srli_epi16(_mm_add_epi16(sum, round), 2);
+        };
+        for (; x + 4 <= out_pixels; x += 4) {
+            auto offset = size_t(x) * 8;
+            auto a0 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(top + offset));
+            auto a1 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(top + offset + 16));
+            auto b0 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(bottom + offset));
+            auto b1 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(bottom + offset + 16));
+            _mm_storeu_si128(reinterpret_cast<__m128i *>(out + size_t(x) * 4), _mm_packus_epi16(average(a0, b0), average(a1, b1)));
+        }
+    }
+#endif
+    for (; x < out_pixels; ++x) {
+        for (int c = 0; c < 4; ++c) {
+            auto sum = top[x * 8 + c] + top[x * 8 + 4 + c] + bottom[x * 8 + c] + bottom[x * 8 + 4 + c];
+            out[x * 4 + c] = uint8_t((sum + 2) >> 2);
+        }
+    }
+}
+
+void convert::shrink4(const uint8_t *bgra, size_t pitch, uint8_t *out, int out_pixels) {
+    int x = 0;
+#if defined(FRAME_SSE2)
+    {
+        auto round = _mm_set1_epi16(8);
+        // one 4x4 block to one pixel, in the low 64 bits as 16 bit lanes
+        auto block = [&](const uint8_t *source) {
+            __m128i lo = _mm_setzero_si128(), hi = _mm_setzero_si128();
+            for (int row = 0; row < 4; row += 2) {
+                __m128i row_hi;
+                auto a = _mm_loadu_si128(reinterpret_cast<const __m128i *>(source + pitch * row));
+                auto b = _mm_loadu_si128(reinterpret_cast<const __m128i *>(source + pitch * (row + 1)));
+                lo = _mm_add_epi16(lo, widen_add(a, b, row_hi));
+                hi = _mm_add_epi16(hi, row_hi);
+            }
+            auto sum = _mm_add_epi16(lo, hi);
+            return _mm_add_epi16(sum, _mm_srli_si128(sum, 8));
+        };
+        for (; x + 4 <= out_pixels; x += 4) {
+            auto source = bgra + size_t(x) * 16;
+            auto first = _mm_unpacklo_epi64(block(source), block(source + 16));
+            auto second = _mm_unpacklo_epi64(block(source + 32), block(source + 48));
+            first = _mm_srli_epi16(_mm_add_epi16(first, round), 4);
+            second = _mm_srli_epi16(_mm_add_epi16(second, round), 4);
+            _mm_storeu_si128(reinterpret_cast<__m128i *>(out + size_t(x) * 4), _mm_packus_epi16(first, second));
+        }
+    }
+#endif
+    for (; x < out_pixels; ++x) {
+        for (int c = 0; c < 4; ++c) {
+            int sum = 0;
+            for (int row = 0; row < 4; ++row) {
+                for (int column = 0; column < 4; ++column)
+                    sum += bgra[pitch * row + (size_t(x) * 4 + column) * 4 + c];
+            }
+            out[x * 4 + c] = uint8_t((sum + 8) >> 4);
+        }
+    }
+}
+
+bool convert::can_copy(int source_width, int source_height, const rect &roi, const mutable_image_view &dest, int factor) {
+    if (factor != 1 && factor != 2 && factor != 4) {
+        return false;
+    }
+    if (roi.x < 0 || roi.y < 0 || roi.width <= 0 || roi.height <= 0 || roi.x + roi.width > source_width || roi.y + roi.height > source_height) {
+        return false;
+    }
+    return dest && dest.width == roi.width / factor && dest.height == roi.height / factor;
+}
+
+bool convert::copy(const image_view &source, const rect &roi, const mutable_image_view &dest, int factor) {
+    if (!source || source.format != pixel_format::bgra || !can_copy(source.width, source.height, roi, dest, factor)) {
+        return false;
+    }
+    auto width = roi.width / factor, height = roi.height / factor;
+
+    // shrunk pixels go through a small stack line that stays in L1, unless
+    // the destination is BGRA and can take them directly
+    constexpr int line_pixels = 512;
+    alignas(16) uint8_t line[line_pixels * 4];
+    auto bytes = pixel_bytes(dest.format);
+
+    for (int y = 0; y < height; ++y) {
+        auto from = source.at(roi.x, roi.y + y * factor);
+        auto to = dest.row(y);
+
+        for (int x = 0; x < width; x += line_pixels) {
+            auto count = std::min(line_pixels, width - x);
+            auto pixels = from + size_t(x) * factor * 4;
+
+            if (factor != 1) {
+                auto shrunk = dest.format == pixel_format::bgra ? to + size_t(x) * 4 : line;
+                if (factor == 2)
+                    shrink2(pixels, size_t(source.pitch), shrunk, count);
+                else
+                    shrink4(pixels, size_t(source.pitch), shrunk, count);
+                if (dest.format == pixel_format::bgra)
+                    continue;
+                pixels = line;
+            }
+
+            switch (dest.format) {
+            case pixel_format::bgra:
+                std::memcpy(to + size_t(x) * 4, pixels, size_t(count) * 4);
+                break;
+            case pixel_format::rgb24:
+                bgra_to_rgb24(pixels, to + size_t(x) * bytes, count);
+                break;
+            case pixel_format::gray:
+                bgra_to_gray(pixels, to + size_t(x) * bytes, count);
+                break;
+            }
+        }
+    }
+    return true;
+}
+
+// frame_source's default, here so frame_source.h does not pull in the kernels
+bool frame_source::update_roi(const rect &roi, const mutable_image_view &out, int factor) {
+    return convert::can_copy(width(), height(), roi, out, factor) && update() &&
+           convert::copy(image_view(bitmap(), width(), height(), pitch()), roi, out, factor);
+}
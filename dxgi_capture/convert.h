@@ -0,0 +1,31 @@
+#pragma once
+
+#include "image_view.h"
+
+// Region copy out of a BGRA frame with format conversion and box
+// downscaling done in the same pass, so a mapped surface is read once and
+// only the pixels that are kept get written: a half size gray copy moves a
+// sixteenth of the bytes a full BGRA copy does.
+//
+//   image_buffer gray(roi.width / 2, roi.height / 2, pixel_format::gray);
+//   convert::copy(frame, roi, gray.view(), 2);
+namespace convert {
+	// copy `roi` of `source` (BGRA) into `dest`, converting to dest.format and
+	// averaging `factor` x `factor` blocks (1, 2 or 4). `roi` must lie inside
+	// the source and dest must be roi.width / factor x roi.height / factor;
+	// false otherwise, nothing is written then.
+	bool copy(const image_view& source, const rect& roi, const mutable_image_view& dest, int factor = 1);
+
+	// whether copy() accepts these arguments for a BGRA source of the given
+	// size, so callers can reject bad ones before fetching a frame
+	bool can_copy(int source_width, int source_height, const rect& roi, const mutable_image_view& dest, int factor = 1);
+
+	// single rows, `pixels` pixels each
+	void bgra_to_gray(const uint8_t* bgra, uint8_t* gray, int pixels);
+	void bgra_to_rgb24(const uint8_t* bgra, uint8_t* rgb, int pixels);
+
+	// `out_pixels` BGRA pixels, each the average of a factor x factor block
+	// starting at `bgra`, source rows `pitch` bytes apart
+	void shrink2(const uint8_t* bgra, size_t pitch, uint8_t* out, int out_pixels);
+	void shrink4(const uint8_t* bgra, size_t pitch, uint8_t* out, int out_pixels);
+}
@@ -0,0 +1,224 @@
+#include "frame_codec.h"
+#include "simd.h"
+
+#include <cstring>
+
+namespace {
+    constexpr int hash_bits = 13;
+    constexpr size_t min_match = 4;
+    constexpr size_t max_offset = 0xFFFF;
+
+    uint32_t read32(const uint8_t *p) {
+        uint32_t value;
+        std::memcpy(&value, p, 4);
+        return value;
+    }
+
+    uint64_t read64(const uint8_t *p) {
+        uint64_t value;
+        std::memcpy(&value, p, 8);
+        return value;
+    }
+
+    uint32_t hash(uint32_t value) {
+        return (value * 2654435761u) >> (32 - hash_bits);
+    }
+
+    // bytes equal at `a` and `b`, compared 8 at a time
+    size_t common_length(const uint8_t *a, const uint8_t *b, const uint8_t *a_end) {
+        auto start = a;
+        while (a + 8 <= a_end) {
+            auto diff = read64(a) ^ read64(b);
+            if (diff != 0) {
+#if defined(_MSC_VER)
+                unsigned long index;
+                _BitScanForward64(&index, diff);
+                return size_t(a - start) + index / 8;
+#else
+                return size_t(a - start) + size_t(__builtin_ctzll(diff)) / 8;
+#endif
+            }
+            a += 8;
+            b += 8;
+        }
+        while (a < a_end && *a == *b) {
+            ++a;
+            ++b;
+        }
+        return size_t(a - start);
+    }
+
+    // lengths of 15 and more continue in bytes of 255, the last one below 255
+    uint8_t *write_length(uint8_t *out, size_t length) {
+        for (; length >= 255; length -= 255)
+            *out++ = 255;
+        *out++ = uint8_t(length);
+        return out;
+    }
+
+    uint8_t *write_sequence(uint8_t *out, const uint8_t *literals, size_t literal_length, size_t offset, size_t match_length) {
+        auto token = out++;
+        auto match_code = match_length >= min_match ? match_length - min_match : 0;
+        *token = uint8_t((literal_length < 15 ? literal_length : 15) << 4 | (match_code < 15 ? match_code : 15));
+
+        if (literal_length >= 15)
+            out = write_length(out, literal_length - 15);
+        if (literal_length != 0)
+            std::memcpy(out, literals, literal_length);
+        out += literal_length;
+
+        if (match_length == 0)
+            return out; // last sequence, literals only
+
+        *out++ = uint8_t(offset);
+        *out++ = uint8_t(offset >> 8);
+        if (match_code >= 15)
+            out = write_length(out, match_code - 15);
+        return out;
+    }
+
+    bool read_length(const uint8_t *&in, const uint8_t *end, size_t &length) {
+        uint8_t more;
+        do {
+            if (in == end)
+                return false;
+            more = *in++;
+            length += more;
+        } while (more == 255);
+        return true;
+    }
+}
+
+size_t codec::compress(const uint8_t *in, size_t size, uint8_t *out) {
+    uint32_t table[1 << hash_bits] = {}; // position + 1, 0 for empty
+    auto start = out;
+    size_t anchor = 0;
+    size_t i = 0;
+
+    while (i + min_match <= size) {
+        auto value = read32(in + i);
+        auto &slot = table[hash(value)];
+        auto candidate = size_t(slot) - 1;
+        slot = uint32_t(i + 1);
+
+        if (candidate == size_t(-1) || i - candidate > max_offset || read32(in + candidate) != value) {
+            // the longer nothing matched, the bigger the steps, so incompressible data stays cheap
+            i += 1 + ((i - anchor) >> 6);
+            continue;
+        }
+
+        auto length = min_match + common_length(in + i + min_match, in + candidate + min_match, in + size);
+        out = write_sequence(out, in + anchor, i - anchor, i - candidate, length);
+        i += length;
+        anchor = i;
+
+        // keep the table warm right behind the match, the next one often starts there
+        if (i + 2 <= size)
+            table[hash(read32(in + i - 2))] = uint32_t(i - 2 + 1);
+    }
+
+    out = write_sequence(out, in + anchor, size - anchor, 0, 0);
+    return size_t(out - start);
+}
+
+bool codec::decompress(const uint8_t *in, size_t size, uint8_t *out, size_t out_size) {
+    auto end = in + size;
+    auto start = out;
+    auto out_end = out + out_size;
+
+    while (in < end) {
+        auto token = *in++;
+
+        size_t literal_length = token >> 4;
+        if (literal_length == 15 && !read_length(in, end, literal_length))
+            return false;
+        if (literal_length > size_t(end - in) || literal_length > size_t(out_end - out))
+            return false;
+        if (literal_length != 0)
+            std::memcpy(out, in, literal_length);
+        in += literal_length;
+        out += literal_length;
+
+        if (in == end)
+            break;
+
+        if (end - in < 2)
+            return false;
+        size_t offset = size_t(in[0]) | size_t(in[1]) << 8;
+        in += 2;
+
+        size_t match_length = (token & 0x0F);
+        if (match_length == 15 && !read_length(in, end, match_length))
+            return false;
+        match_length += min_match;
+
+        if (offset == 0 || offset > size_t(out - start) || match_length > size_t(out_end - out))
+            return false;
+
+        auto from = out - offset;
+        if (offset == 1) {
+            std::memset(out, *from, match_length);
+        } else if (offset >= match_length) {
+            std::memcpy(out, from, match_length);
+        } else {
+            // overlapping: the repeated pattern doubles with every copy
+            auto left = match_length;
+            auto chunk = offset;
+            while (left > 0) {
+                auto n = chunk < left ? chunk : left;
+                std::memcpy(out, from, n);
+                out += n;
+                left -= n;
+                chunk = size_t(out - from);
+            }
+            continue;
+        }
+        out += match_length;
+    }
+    return out == out_end;
+}
+
+void codec::xor_delta(const uint8_t *current, uint8_t *previous, uint8_t *delta, size_t bytes) {
+    size_t i = 0;
+#if defined(FRAME_AVX2)
+    for (; i + 32 <= bytes; i += 32) {
+        auto c = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(current + i));
+        auto p = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(previous + i));
+        _mm256_storeu_si256(reinterpret_cast<__m256i *>(delta + i), _mm256_xor_si256(c, p));
+        _mm256_storeu_si256(reinterpret_cast<__m256i *>(previous + i), c);
+    }
+#endif
+#if defined(FRAME_SSE2)
+    for (; i + 16 <= bytes; i += 16) {
+        auto c = _mm_loadu_si128(reinterpret_cast<const __m128i *>(current + i));
+        auto p = _mm_loadu_si128(reinterpret_cast<const __m128i *>(previous + i));
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(delta + i), _mm_xor_si128(c, p));
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(previous + i), c);
+    }
+#endif
+    for (; i < bytes; ++i) {
+        delta[i] = current[i] ^ previous[i];
+        previous[i] = current[i];
+    }
+}
+
+void codec::xor_apply(uint8_t *frame, const uint8_t *delta, size_t bytes) {
+    size_t i = 0;
+#if defined(FRAME_AVX2)
+    for (; i + 32 <= bytes; i += 32) {
+        auto f = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(frame + i));
+        auto d = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(delta + i));
+        _mm256_storeu_si256(reinterpret_cast<__m256i *>(frame + i), _mm256_xor_si256(f, d));
+    }
+#endif
+#if defined(FRAME_SSE2)
+    for (; i + 16 <= bytes; i += 16) {
+        auto f = _mm_loadu_si128(reinterpret_cast<const __m128i *>(frame + i));
+        auto d = _mm_loadu_si128(reinterpret_cast<const __m128i *>(delta + i));
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(frame + i), _mm_xor_si128(f, d));
+    }
+#endif
+    for (; i < bytes; ++i) {
+        frame[i] ^= delta[i];
+    }
+}
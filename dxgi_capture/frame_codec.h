@@ -0,0 +1,27 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Byte codec for recorded frames. A delta frame is the XOR of two
+// consecutive frames, so everything that did not change becomes zero, and
+// both keyframes and deltas then go through a small LZ77 coder (LZ4 style
+// tokens: literal run, 16 bit offset, match length). Runs of one byte are
+// matches at offset 1, so the long zero runs of a delta cost a few bytes
+// and are found with one extension loop instead of per byte work.
+namespace codec {
+	// room compress() may need for `size` input bytes
+	inline size_t compress_bound(size_t size) { return size + size / 255 + 16; }
+
+	// returns the compressed size, `out` needs compress_bound(size) bytes
+	size_t compress(const uint8_t* in, size_t size, uint8_t* out);
+
+	// false when the input is damaged or does not decode to exactly `out_size` bytes
+	bool decompress(const uint8_t* in, size_t size, uint8_t* out, size_t out_size);
+
+	// delta = current ^ previous, then previous = current, in one pass
+	void xor_delta(const uint8_t* current, uint8_t* previous, uint8_t* delta, size_t bytes);
+
+	// frame ^= delta, turns the previous frame into the current one
+	void xor_apply(uint8_t* frame, const uint8_t* delta, size_t bytes);
+}
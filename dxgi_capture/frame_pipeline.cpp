@@ -0,0 +1,134 @@
+#include "frame_pipeline.h"
+
+#include <algorithm>
+
+frame_pipeline::frame_pipeline(frame_source &source, int buffers)
+    : _source(source), _slots(size_t(std::clamp(buffers, 2, max_buffers))) {
+    for (size_t i = 0; i < _slots.size(); ++i) {
+        _free.push(uint8_t(i));
+    }
+}
+
+frame_pipeline::~frame_pipeline() {
+    stop();
+}
+
+void frame_pipeline::start() {
+    if (_thread.joinable()) {
+        return;
+    }
+    _stop.store(false, std::memory_order_relaxed);
+    _thread = std::thread([this] { run(); });
+}
+
+void frame_pipeline::stop() {
+    _stop.store(true, std::memory_order_relaxed);
+    if (_thread.joinable()) {
+        _thread.join();
+    }
+}
+
+void frame_pipeline::run() {
+    while (!_stop.load(std::memory_order_relaxed)) {
+        if (pump()) {
+            continue;
+        }
+
+        // nothing to fill into, wait for the consumer to hand a buffer back
+        if (_filling < 0) {
+            uint8_t slot;
+            if (_free.pop_for(slot, std::chrono::milliseconds(5))) {
+                _filling = slot;
+                _starving = false;
+            }
+            continue;
+        }
+
+        // the source had nothing new: sources pace themselves, this only
+        // keeps an exhausted one from spinning
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+}
+
+bool frame_pipeline::pump() {
+    if (_filling < 0) {
+        uint8_t slot;
+        if (!_free.try_pop(slot)) {
+            // once per stretch without buffers, not per poll
+            if (!_starving) {
+                _starving = true;
+                _starved.fetch_add(1, std::memory_order_relaxed);
+            }
+            return false;
+        }
+        _filling = slot;
+        _starving = false;
+    }
+
+    auto &slot = _slots[size_t(_filling)];
+    auto width = _source.width(), height = _source.height();
+    if (width <= 0 || height <= 0) {
+        return false;
+    }
+    if (slot.width != width || slot.height != height) {
+        // only on the first frames and after the source changed size
+        slot.width = width;
+        slot.height = height;
+        slot.pitch = width * 4;
+        slot.data.resize(size_t(slot.pitch) * height);
+    }
+
+    if (!_source.update_into(slot.data.data(), slot.pitch, slot.width, slot.height)) {
+        return false;
+    }
+
+    slot.sequence = _sequence++;
+    slot.time = std::chrono::steady_clock::now();
+
+    // the ring holds at most every slot, so this never waits
+    _ready.push(uint8_t(_filling));
+    _filling = -1;
+    _produced.fetch_add(1, std::memory_order_relaxed);
+    return true;
+}
+
+void frame_pipeline::fill(frame &out, int slot) {
+    auto &source = _slots[size_t(slot)];
+    out.bits = source.data.data();
+    out.width = source.width;
+    out.height = source.height;
+    out.pitch = source.pitch;
+    out.sequence = source.sequence;
+    out.time = source.time;
+    out.slot = slot;
+}
+
+bool frame_pipeline::acquire(frame &out, std::chrono::steady_clock::duration timeout) {
+    uint8_t slot;
+    if (!_ready.try_pop(slot) && (timeout <= timeout.zero() || !_ready.pop_for(slot, timeout))) {
+        return false;
+    }
+    fill(out, slot);
+    return true;
+}
+
+bool frame_pipeline::acquire_latest(frame &out, std::chrono::steady_clock::duration timeout) {
+    if (!acquire(out, timeout)) {
+        return false;
+    }
+
+    uint8_t slot;
+    while (_ready.try_pop(slot)) {
+        release(out);
+        fill(out, slot);
+    }
+    return true;
+}
+
+void frame_pipeline::release(frame &frame) {
+    if (frame.slot < 0) {
+        return;
+    }
+    _free.push(uint8_t(frame.slot));
+    frame = {};
+}
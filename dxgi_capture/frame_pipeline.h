@@ -0,0 +1,106 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <stdint.h>
+#include <thread>
+#include <vector>
+
+#include "frame_source.h"
+#include "../spsc_queue/spsc_queue.hpp"
+
+// Hands frames from a capture thread to one consumer without copying them
+// again and without allocating per frame. A fixed pool of buffers (three by
+// default: one being filled, one ready, one being read) circulates through
+// two SPSC rings of buffer indices:
+//
+//   free ring:  consumer -> capture thread, buffers that may be filled
+//   ready ring: capture thread -> consumer, completed frames in order
+//
+// The source writes every frame straight into a pool buffer (update_into),
+// and a buffer the consumer holds is never written until it comes back
+// through release(), so a frame cannot change underneath its reader.
+//
+//   frame_pipeline pipeline(source);
+//   pipeline.start();
+//   frame_pipeline::frame frame;
+//   while (pipeline.acquire_latest(frame, std::chrono::milliseconds(100))) {
+//       ...read frame.bits...
+//       pipeline.release(frame);
+//   }
+//
+// acquire* and release must be called from one consumer thread. Instead of
+// start(), pump() may be called by hand from one producer thread.
+class frame_pipeline
+{
+public:
+	static constexpr int max_buffers = 15;
+
+	struct frame {
+		const uint8_t* bits = nullptr;
+		int width = 0;
+		int height = 0;
+		int pitch = 0;
+		uint64_t sequence = 0; // counts published frames, gaps are frames acquire_latest skipped
+		std::chrono::steady_clock::time_point time;
+		int slot = -1;
+	};
+
+	explicit frame_pipeline(frame_source& source, int buffers = 3);
+	~frame_pipeline();
+
+	frame_pipeline(const frame_pipeline&) = delete;
+	frame_pipeline& operator=(const frame_pipeline&) = delete;
+
+	// run pump() on a capture thread until stop()
+	void start();
+	void stop();
+
+	// fetch one frame into a free buffer and publish it, false when there was
+	// no free buffer or no new frame
+	bool pump();
+
+	// oldest ready frame, false when none arrived within `timeout`
+	bool acquire(frame& out, std::chrono::steady_clock::duration timeout = std::chrono::steady_clock::duration::zero());
+
+	// newest ready frame, the older ones go straight back to the pool
+	bool acquire_latest(frame& out, std::chrono::steady_clock::duration timeout = std::chrono::steady_clock::duration::zero());
+
+	void release(frame& frame);
+
+	uint64_t produced() const { return _produced.load(std::memory_order_relaxed); }
+
+	// times pump() ran out of buffers because the consumer held them all,
+	// counted once until one comes back however long that takes
+	uint64_t starved() const { return _starved.load(std::memory_order_relaxed); }
+
+private:
+	struct slot_t {
+		std::vector<uint8_t> data;
+		int width = 0;
+		int height = 0;
+		int pitch = 0;
+		uint64_t sequence = 0;
+		std::chrono::steady_clock::time_point time;
+	};
+
+	// one slot more than buffers, an SPSC ring holds size - 1 values
+	using ring_t = SpscQueue<uint8_t, max_buffers + 1, ParkWait<>, DenseLayout>;
+
+	void run();
+	void fill(frame& out, int slot);
+
+	frame_source& _source;
+	std::vector<slot_t> _slots;
+	ring_t _free;
+	ring_t _ready;
+
+	int _filling = -1; // slot the producer holds between pump() calls
+	bool _starving = false; // producer side, the current stretch without buffers is counted
+	uint64_t _sequence = 0;
+	std::atomic<uint64_t> _produced{0};
+	std::atomic<uint64_t> _starved{0};
+
+	std::thread _thread;
+	std::atomic<bool> _stop{false};
+};
@@ -0,0 +1,319 @@
+#include "frame_recorder.h"
+#include "frame_codec.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+
+#include "../thread_pool/thread_pool.hpp"
+
+namespace {
+    constexpr char index_magic[4] = {'F', 'R', 'E', 'C'};
+    constexpr uint32_t index_version = 1;
+
+    // little endian on disk, like the zip headers around them
+    struct frame_header {
+        uint32_t width;
+        uint32_t height;
+        int64_t time;
+        uint32_t key;
+        uint32_t packed_size;
+    };
+
+    struct segment_record {
+        uint64_t first_frame;
+        int64_t time;
+        uint32_t frames;
+        uint32_t reserved;
+    };
+
+    template <typename T>
+    void append(std::vector<uint8_t> &out, const T &value) {
+        auto at = out.size();
+        out.resize(at + sizeof(T));
+        std::memcpy(&out[at], &value, sizeof(T));
+    }
+
+    template <typename T>
+    bool take(const std::vector<uint8_t> &in, size_t &offset, T &value) {
+        if (in.size() - offset < sizeof(T))
+            return false;
+        std::memcpy(&value, &in[offset], sizeof(T));
+        offset += sizeof(T);
+        return true;
+    }
+
+    std::string segment_name(uint32_t segment) {
+        char name[32];
+        std::snprintf(name, sizeof(name), "segment_%06u", segment);
+        return name;
+    }
+}
+
+frame_recorder::frame_recorder(ThreadPool *pool, int keyframe_interval, int in_flight)
+    : _pool(pool), _keyframe_interval(std::max(keyframe_interval, 1)) {
+    _slots.resize(size_t(std::max(in_flight, 1)));
+    for (auto &slot : _slots) {
+        slot = std::make_unique<slot_t>();
+    }
+    _since_key = _keyframe_interval;
+}
+
+frame_recorder::~frame_recorder() {
+    collect(true);
+
+    // a worker that published its slot may still be inside notify()
+    while (_running.load(std::memory_order_acquire) != 0)
+        spsc_detail::cpu_relax();
+}
+
+void frame_recorder::compress(slot_t &slot) {
+    // the capacity stays with the slot, so after the first frames this never allocates
+    slot.packed.resize(codec::compress_bound(slot.raw.size()));
+    slot.packed_size = codec::compress(slot.raw.data(), slot.raw.size(), slot.packed.data());
+    slot.done.store(true, std::memory_order_release);
+    slot.wake.notify();
+}
+
+frame_recorder::slot_t &frame_recorder::next_slot() {
+    collect(false);
+    if (_count == _slots.size()) {
+        // every slot is being compressed, the workers are behind: wait for the oldest
+        auto &oldest = *_slots[_head];
+        oldest.wake.wait([&] { return oldest.done.load(std::memory_order_acquire); }, spsc_detail::forever);
+        collect(false);
+    }
+    auto &slot = *_slots[(_head + _count) % _slots.size()];
+    ++_count;
+    return slot;
+}
+
+// hand finished slots to the archive in recording order
+void frame_recorder::collect(bool wait) {
+    while (_count > 0) {
+        auto &slot = *_slots[_head];
+        if (!slot.done.load(std::memory_order_acquire)) {
+            if (!wait)
+                return;
+            slot.wake.wait([&] { return slot.done.load(std::memory_order_acquire); }, spsc_detail::forever);
+        }
+        store(slot);
+        slot.done.store(false, std::memory_order_relaxed);
+        _head = (_head + 1) % _slots.size();
+        --_count;
+    }
+}
+
+void frame_recorder::store(slot_t &slot) {
+    if (slot.key) {
+        flush_segment();
+        segment_record record = {_frames, slot.time, 0, 0};
+        append(_index, record);
+    }
+
+    // frames of the open segment are counted in its index record
+    auto record_at = _index.size() - sizeof(segment_record);
+    segment_record record;
+    std::memcpy(&record, &_index[record_at], sizeof(record));
+    record.frames += 1;
+    std::memcpy(&_index[record_at], &record, sizeof(record));
+
+    frame_header header = {uint32_t(slot.width), uint32_t(slot.height), slot.time, slot.key ? 1u : 0u, uint32_t(slot.packed_size)};
+    append(_segment, header);
+    _segment.insert(_segment.end(), slot.packed.begin(), slot.packed.begin() + slot.packed_size);
+
+    _frames += 1;
+    _raw_bytes += slot.raw.size();
+    _stored_bytes += slot.packed_size;
+}
+
+void frame_recorder::flush_segment() {
+    if (_segment.empty()) {
+        return;
+    }
+    _zip.add(segment_name(_segments++), std::move(_segment));
+    _segment = {};
+}
+
+void frame_recorder::record(const image_view &frame) {
+    record(frame, std::chrono::steady_clock::now());
+}
+
+void frame_recorder::record(frame_source &source) {
+    record(image_view(source.bitmap(), source.width(), source.height(), source.pitch()));
+}
+
+void frame_recorder::record(const image_view &frame, std::chrono::steady_clock::time_point time) {
+    if (!frame || frame.format != pixel_format::bgra) {
+        return;
+    }
+    if (_start == std::chrono::steady_clock::time_point()) {
+        _start = time;
+    }
+
+    auto &slot = next_slot();
+    auto row_bytes = size_t(frame.width) * 4;
+    slot.key = _since_key >= _keyframe_interval || frame.width != _width || frame.height != _height;
+    slot.width = frame.width;
+    slot.height = frame.height;
+    slot.time = std::chrono::duration_cast<std::chrono::microseconds>(time - _start).count();
+    slot.raw.resize(row_bytes * frame.height);
+
+    if (slot.key) {
+        _width = frame.width;
+        _height = frame.height;
+        _previous.resize(slot.raw.size());
+        for (int y = 0; y < frame.height; ++y) {
+            std::memcpy(&slot.raw[row_bytes * y], frame.row(y), row_bytes);
+        }
+        std::memcpy(_previous.data(), slot.raw.data(), slot.raw.size());
+        _since_key = 1;
+    } else {
+        for (int y = 0; y < frame.height; ++y) {
+            codec::xor_delta(frame.row(y), &_previous[row_bytes * y], &slot.raw[row_bytes * y], row_bytes);
+        }
+        _since_key += 1;
+    }
+
+    if (_pool == nullptr) {
+        compress(slot);
+        return;
+    }
+
+    _running.fetch_add(1, std::memory_order_relaxed);
+    auto target = &slot;
+    auto running = &_running;
+    _pool->submit([target, running] {
+        compress(*target);
+        running->fetch_sub(1, std::memory_order_release);
+    });
+}
+
+zipper::Error frame_recorder::save(const std::string &file_name) {
+    collect(true);
+    flush_segment();
+
+    std::vector<uint8_t> index(index_magic, index_magic + 4);
+    append(index, index_version);
+    append(index, uint32_t(_index.size() / sizeof(segment_record)));
+    index.insert(index.end(), _index.begin(), _index.end());
+    _zip.remove("index");
+    _zip.add("index", std::move(index));
+
+    // the open segment went into the archive, the next frame starts another
+    _since_key = _keyframe_interval;
+    return _zip.save(file_name);
+}
+
+zipper::Error frame_player::open(const std::string &file_name) {
+    // read into locals, a failed open leaves the current recording playable
+    zipper::Zipper zip;
+    auto error = zip.load(file_name);
+    if (error != zipper::Error::Success) {
+        return error;
+    }
+
+    auto index = zip.data("index");
+    size_t offset = 0;
+    char magic[4];
+    uint32_t version = 0, count = 0;
+    if (index == nullptr || !take(*index, offset, magic) || std::memcmp(magic, index_magic, 4) != 0 ||
+        !take(*index, offset, version) || version != index_version || !take(*index, offset, count)) {
+        return zipper::Error::InvalidFile;
+    }
+
+    std::vector<segment_t> segments;
+    uint64_t frame_count = 0;
+    for (uint32_t i = 0; i < count; ++i) {
+        segment_record record;
+        if (!take(*index, offset, record)) {
+            return zipper::Error::InvalidFile;
+        }
+        segments.push_back(segment_t{record.first_frame, record.time, record.frames});
+        frame_count = record.first_frame + record.frames;
+    }
+
+    _zip = std::move(zip);
+    _segments = std::move(segments);
+    _frame_count = frame_count;
+    _data = nullptr;
+    _offset = 0;
+    _position = 0;
+    _have_frame = false;
+    seek(uint64_t(0));
+    return zipper::Error::Success;
+}
+
+bool frame_player::enter(size_t segment) {
+    if (segment >= _segments.size()) {
+        return false;
+    }
+    _segment = segment;
+    _data = _zip.data(segment_name(uint32_t(segment)));
+    _offset = 0;
+    _position = _segments[segment].first_frame;
+    _have_frame = false;
+    return _data != nullptr;
+}
+
+uint64_t frame_player::seek(uint64_t frame) {
+    if (_segments.empty()) {
+        return 0;
+    }
+    auto next = std::upper_bound(_segments.begin(), _segments.end(), frame,
+                                 [](uint64_t value, const segment_t &segment) { return value < segment.first_frame; });
+    auto segment = size_t(std::max<ptrdiff_t>(next - _segments.begin() - 1, 0));
+    enter(segment);
+    return _position;
+}
+
+uint64_t frame_player::seek(std::chrono::microseconds time) {
+    if (_segments.empty()) {
+        return 0;
+    }
+    auto next = std::upper_bound(_segments.begin(), _segments.end(), int64_t(time.count()),
+                                 [](int64_t value, const segment_t &segment) { return value < segment.time; });
+    auto segment = size_t(std::max<ptrdiff_t>(next - _segments.begin() - 1, 0));
+    enter(segment);
+    return _position;
+}
+
+bool frame_player::update() {
+    if (_data == nullptr) {
+        return false;
+    }
+    if (_offset >= _data->size() && !enter(_segment + 1)) {
+        return false;
+    }
+
+    frame_header header;
+    if (!take(*_data, _offset, header) || _data->size() - _offset < header.packed_size) {
+        return false;
+    }
+    auto packed = _data->data() + _offset;
+    _offset += header.packed_size;
+
+    auto bytes = size_t(header.width) * header.height * 4;
+    if (header.key) {
+        _width = int(header.width);
+        _height = int(header.height);
+        _frame.resize(bytes);
+        if (!codec::decompress(packed, header.packed_size, _frame.data(), bytes)) {
+            return false;
+        }
+    } else {
+        if (!_have_frame || int(header.width) != _width || int(header.height) != _height) {
+            return false;
+        }
+        _delta.resize(bytes);
+        if (!codec::decompress(packed, header.packed_size, _delta.data(), bytes)) {
+            return false;
+        }
+        codec::xor_apply(_frame.data(), _delta.data(), bytes);
+    }
+
+    _have_frame = true;
+    _time = std::chrono::microseconds(header.time);
+    _position += 1;
+    return true;
+}
@@ -0,0 +1,151 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+#include "frame_source.h"
+#include "../spsc_queue/wait_policy.hpp"
+#include "../zipper/zipper.h"
+
+class ThreadPool;
+
+// Keeps a stream of frames for post-mortem review. Every `keyframe_interval`
+// frames (and whenever the size changes) a whole frame is stored, the frames
+// in between are stored as the XOR with their predecessor, which is zero
+// wherever nothing moved. Both are compressed with codec::compress on the
+// pool's workers, so the recording thread only does the XOR pass.
+//
+// A keyframe and the deltas after it make one zip entry ("segment_000000"),
+// "index" lists where each segment starts, so playback can seek to any
+// keyframe. The archive stays in memory until save(); a segment of two
+// seconds at 60 fps is one entry, so the zip limit of 65535 entries is
+// about a day and a half of recording.
+//
+//   frame_recorder recorder(&pool);
+//   while (...) recorder.record(frame_view);
+//   recorder.save("session.zip");
+//
+// record() and save() must be called from one thread.
+class frame_recorder
+{
+public:
+	explicit frame_recorder(ThreadPool* pool = nullptr, int keyframe_interval = 120, int in_flight = 8);
+	~frame_recorder();
+
+	frame_recorder(const frame_recorder&) = delete;
+	frame_recorder& operator=(const frame_recorder&) = delete;
+
+	// queue one BGRA frame, waits only while `in_flight` frames are still being compressed
+	void record(const image_view& frame);
+	void record(const image_view& frame, std::chrono::steady_clock::time_point time);
+	void record(frame_source& source);
+
+	// finish the frames in flight and write the archive; recording may go on
+	// afterwards, the next frame starts a new segment
+	zipper::Error save(const std::string& file_name);
+
+	uint64_t frames() const { return _frames; }
+	uint64_t raw_bytes() const { return _raw_bytes; }
+	uint64_t stored_bytes() const { return _stored_bytes; }
+
+private:
+	struct slot_t {
+		std::vector<uint8_t> raw; // the frame or the delta, tightly packed
+		std::vector<uint8_t> packed;
+		size_t packed_size = 0;
+		int width = 0;
+		int height = 0;
+		int64_t time = 0; // microseconds since the first frame
+		bool key = false;
+		std::atomic<bool> done{false};
+		ParkWait<> wake;
+	};
+
+	slot_t& next_slot();
+	void collect(bool wait);
+	void store(slot_t& slot);
+	void flush_segment();
+	static void compress(slot_t& slot);
+
+	ThreadPool* _pool;
+	int _keyframe_interval;
+
+	std::vector<std::unique_ptr<slot_t>> _slots;
+	size_t _head = 0;  // oldest slot in flight
+	size_t _count = 0; // slots in flight
+
+	std::vector<uint8_t> _previous; // last frame, what the next delta is taken against
+	int _width = 0;
+	int _height = 0;
+	int _since_key = 0;
+	std::chrono::steady_clock::time_point _start;
+
+	zipper::Zipper _zip;
+	std::vector<uint8_t> _segment;
+	std::vector<uint8_t> _index;
+	uint32_t _segments = 0;
+
+	std::atomic<int> _running{0}; // compress tasks still on the pool
+
+	uint64_t _frames = 0;
+	uint64_t _raw_bytes = 0;
+	uint64_t _stored_bytes = 0;
+};
+
+// Plays a recording back as a frame source.
+class frame_player : public frame_source
+{
+public:
+	// on an error the recording opened before, if any, stays as it was
+	zipper::Error open(const std::string& file_name);
+
+	// decode the next frame, false at the end or on a damaged archive
+	bool update() override;
+
+	int width() override { return _width; }
+	int height() override { return _height; }
+	int pitch() override { return _width * 4; }
+
+	const uint8_t* bitmap() override { return _frame.data(); }
+
+	uint64_t frame_count() const { return _frame_count; }
+
+	// number of the frame the next update() decodes
+	uint64_t position() const { return _position; }
+
+	// when the current frame was recorded, relative to the first one
+	std::chrono::microseconds time() const { return _time; }
+
+	// move to the keyframe at or before `frame` / `time` and return its number
+	uint64_t seek(uint64_t frame);
+	uint64_t seek(std::chrono::microseconds time);
+
+private:
+	struct segment_t {
+		uint64_t first_frame;
+		int64_t time;
+		uint32_t frames;
+	};
+
+	bool enter(size_t segment);
+
+	zipper::Zipper _zip;
+	std::vector<segment_t> _segments;
+	uint64_t _frame_count = 0;
+
+	size_t _segment = 0;
+	const std::vector<uint8_t>* _data = nullptr;
+	size_t _offset = 0;
+	uint64_t _position = 0;
+	bool _have_frame = false; // a delta needs the frame before it
+
+	int _width = 0;
+	int _height = 0;
+	std::chrono::microseconds _time{0};
+	std::vector<uint8_t> _frame;
+	std::vector<uint8_t> _delta;
+};
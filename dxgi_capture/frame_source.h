@@ -0,0 +1,77 @@
+#pragma once
+
+#include <stdint.h>
+#include <string.h>
+#include <vector>
+
+#include "image_view.h"
+
+// BGRA pixel, same byte order as DXGI_FORMAT_B8G8R8A8_UNORM
+struct color {
+	unsigned char b, g, r, a;
+public:
+
+	color(uint32_t col) {
+		r = col >> 24;
+		g = (col >> 16) & 0xFF;
+		b = (col >> 8) & 0xFF;
+		a = col & 0xFF;
+	}
+
+	color() {
+		r = 0;
+		g = 0;
+		b = 0;
+		a = 0;
+	}
+
+	color(int r, int g, int b) {
+		this->r = r;
+		this->g = g;
+		this->b = b;
+		this->a = 255;
+	}
+};
+
+// Where frames come from. `capture` reads the desktop through DXGI (Windows
+// only), synthetic_source / replay_source run anywhere, so everything that
+// consumes frames can be built and measured on Linux too.
+//
+// bitmap() is BGRA, height() rows of pitch() bytes (pitch >= width * 4),
+// and stays valid until the next update(). The default update_roi() lives
+// in convert.cpp, link it into anything that uses a frame_source.
+class frame_source
+{
+public:
+	virtual ~frame_source() = default;
+
+	// fetch the next frame, false when the source failed or ran out
+	virtual bool update() = 0;
+
+	virtual int width() = 0;
+	virtual int height() = 0;
+	virtual int pitch() = 0;
+
+	virtual const uint8_t* bitmap() = 0;
+
+	// fetch the next frame straight into a `width` x `height` buffer of `pitch`
+	// byte rows, false when there is no new frame or it has another size.
+	// The default copies out of bitmap(), sources that can write into the
+	// caller's memory directly override it.
+	virtual bool update_into(uint8_t* bits, int pitch, int width, int height) {
+		if (!update() || width != this->width() || height != this->height())
+			return false;
+		for (int y = 0; y < height; ++y)
+			memcpy(bits + size_t(pitch) * y, bitmap() + size_t(this->pitch()) * y, size_t(width) * 4);
+		return true;
+	}
+
+	// fetch the next frame, copying only `roi` into `out` converted to
+	// out.format and shrunk by `factor` (see convert::copy); false when there
+	// is no new frame or the region does not fit, checked before a frame is taken
+	virtual bool update_roi(const rect& roi, const mutable_image_view& out, int factor = 1);
+
+	// areas the source knows changed since the previous frame (DXGI dirty
+	// and move rects); false when it cannot tell and the frame must be diffed
+	virtual bool change_hints(std::vector<rect>&) { return false; }
+};
@@ -0,0 +1,87 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <type_traits>
+#include <vector>
+
+struct point {
+	int x = 0;
+	int y = 0;
+};
+
+struct rect {
+	int x = 0;
+	int y = 0;
+	int width = 0;
+	int height = 0;
+};
+
+enum class pixel_format {
+	bgra,  // 4 bytes, DXGI_FORMAT_B8G8R8A8_UNORM order
+	rgb24, // 3 bytes, R G B
+	gray   // 1 byte, BT.601 luma
+};
+
+inline int pixel_bytes(pixel_format format) {
+	return format == pixel_format::bgra ? 4 : format == pixel_format::rgb24 ? 3 : 1;
+}
+
+// Borrowed image: `height` rows of `width` pixels, rows `pitch` bytes apart
+// (a mapped texture or a sub rectangle has pitch > width * pixel bytes).
+template <typename Byte>
+struct basic_image_view {
+	Byte* bits = nullptr;
+	int width = 0;
+	int height = 0;
+	int pitch = 0;
+	pixel_format format = pixel_format::bgra;
+
+	basic_image_view() = default;
+
+	basic_image_view(Byte* bits, int width, int height, int pitch, pixel_format format = pixel_format::bgra)
+		: bits(bits), width(width), height(height), pitch(pitch), format(format) {}
+
+	// a mutable view converts to a read only one
+	template <typename Other, typename = std::enable_if_t<std::is_convertible<Other*, Byte*>::value>>
+	basic_image_view(const basic_image_view<Other>& other)
+		: bits(other.bits), width(other.width), height(other.height), pitch(other.pitch), format(other.format) {}
+
+	Byte* row(int y) const { return bits + size_t(pitch) * y; }
+	Byte* at(int x, int y) const { return row(y) + size_t(x) * pixel_bytes(format); }
+
+	// the pixels from (x, y) on, the sub image must lie inside the view
+	basic_image_view sub(int x, int y, int sub_width, int sub_height) const {
+		return basic_image_view(at(x, y), sub_width, sub_height, pitch, format);
+	}
+
+	explicit operator bool() const { return bits != nullptr && width > 0 && height > 0; }
+};
+
+using image_view = basic_image_view<const uint8_t>;
+using mutable_image_view = basic_image_view<uint8_t>;
+
+// Owning, tightly packed image; resize() keeps the allocation when it can.
+class image_buffer
+{
+public:
+	image_buffer() = default;
+	image_buffer(int width, int height, pixel_format format = pixel_format::bgra) { resize(width, height, format); }
+
+	void resize(int width, int height, pixel_format format = pixel_format::bgra) {
+		_view = mutable_image_view(nullptr, width, height, width * pixel_bytes(format), format);
+		_data.resize(size_t(_view.pitch) * height);
+		_view.bits = _data.data();
+	}
+
+	const mutable_image_view& view() { return _view; }
+	image_view view() const { return _view; }
+
+	int width() const { return _view.width; }
+	int height() const { return _view.height; }
+	pixel_format format() const { return _view.format; }
+
+private:
+	std::vector<uint8_t> _data;
+	mutable_image_view _view;
+};
@@ -0,0 +1,497 @@
+#include "region_search.h"
+#include "simd.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+#include "../thread_pool/thread_pool.hpp"
+
+namespace {
+    // alpha is the high byte of a little endian BGRA pixel
+    constexpr uint32_t rgb_mask = 0x00FFFFFF;
+
+    uint32_t load_pixel(const uint8_t *p) {
+        uint32_t pixel;
+        std::memcpy(&pixel, p, 4);
+        return pixel;
+    }
+
+    bool matches(uint32_t pixel, uint32_t target, uint32_t tolerance) {
+        for (int shift = 0; shift < 32; shift += 8) {
+            auto a = int((pixel >> shift) & 0xFF), b = int((target >> shift) & 0xFF);
+            if (std::abs(a - b) > int((tolerance >> shift) & 0xFF))
+                return false;
+        }
+        return true;
+    }
+
+    // hit(x) for every matching pixel of the row, stops early when hit returns false
+    template <typename F>
+    bool scan_row(const uint8_t *row, int pixels, uint32_t target, uint32_t tolerance, F &&hit) {
+        int x = 0;
+#if defined(FRAME_AVX2)
+        {
+            auto t = _mm256_set1_epi32(int(target));
+            auto tol = _mm256_set1_epi32(int(tolerance));
+            auto zero = _mm256_setzero_si256();
+            for (; x + 8 <= pixels; x += 8) {
+                auto p = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(row + size_t(x) * 4));
+                auto diff = _mm256_or_si256(_mm256_subs_epu8(p, t), _mm256_subs_epu8(t, p));
+                auto ok = _mm256_cmpeq_epi8(_mm256_subs_epu8(diff, tol), zero);
+                auto mask = uint32_t(_mm256_movemask_ps(_mm256_castsi256_ps(_mm256_cmpeq_epi32(ok, _mm256_cmpeq_epi8(zero, zero)))));
+                for (; mask != 0; mask &= mask - 1) {
+                    if (!hit(x + int(simd::count_trailing_zeros(mask))))
+                        return false;
+                }
+            }
+        }
+#endif
+#if defined(FRAME_SSE2)
+        {
+            auto t = _mm_set1_epi32(int(target));
+            auto tol = _mm_set1_epi32(int(tolerance));
+            auto zero = _mm_setzero_si128();
+            for (; x + 4 <= pixels; x += 4) {
+                auto p = _mm_loadu_si128(reinterpret_cast<const __m128i *>(row + size_t(x) * 4));
+                auto diff = _mm_or_si128(_mm_subs_epu8(p, t), _mm_subs_epu8(t, p));
+                auto ok = _mm_cmpeq_epi8(_mm_subs_epu8(diff, tol), zero);
+                auto mask = uint32_t(_mm_movemask_ps(_mm_castsi128_ps(_mm_cmpeq_epi32(ok, _mm_cmpeq_epi8(zero, zero)))));
+                for (; mask != 0; mask &= mask - 1) {
+                    if (!hit(x + int(simd::count_trailing_zeros(mask))))
+                        return false;
+                }
+            }
+        }
+#endif
+        for (; x < pixels; ++x) {
+            if (matches(load_pixel(row + size_t(x) * 4), target, tolerance) && !hit(x))
+                return false;
+        }
+        return true;
+    }
+
+    size_t count_row(const uint8_t *row, int pixels, uint32_t target, uint32_t tolerance) {
+        size_t total = 0;
+        int x = 0;
+#if defined(FRAME_AVX2)
+        {
+            auto t = _mm256_set1_epi32(int(target));
+            auto tol = _mm256_set1_epi32(int(tolerance));
+            auto zero = _mm256_setzero_si256();
+            auto ones = _mm256_cmpeq_epi8(zero, zero);
+            auto counts = zero;
+            for (; x + 8 <= pixels; x += 8) {
+                auto p = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(row + size_t(x) * 4));
+                auto diff = _mm256_or_si256(_mm256_subs_epu8(p, t), _mm256_subs_epu8(t, p));
+                auto ok = _mm256_cmpeq_epi8(_mm256_subs_epu8(diff, tol), zero);
+                counts = _mm256_sub_epi32(counts, _mm256_cmpeq_epi32(ok, ones)); // -1 per match
+            }
+            alignas(32) uint32_t lanes[8];
+            _mm256_store_si256(reinterpret_cast<__m256i *>(lanes), counts);
+            for (auto lane : lanes)
+                total += lane;
+        }
+#endif
+#if defined(FRAME_SSE2)
+        {
+            auto t = _mm_set1_epi32(int(target));
+            auto tol = _mm_set1_epi32(int(tolerance));
+            auto zero = _mm_setzero_si128();
+            auto ones = _mm_cmpeq_epi8(zero, zero);
+            auto counts = zero;
+            for (; x + 4 <= pixels; x += 4) {
+                auto p = _mm_loadu_si128(reinterpret_cast<const __m128i *>(row + size_t(x) * 4));
+                auto diff = _mm_or_si128(_mm_subs_epu8(p, t), _mm_subs_epu8(t, p));
+                auto ok = _mm_cmpeq_epi8(_mm_subs_epu8(diff, tol), zero);
+                counts = _mm_sub_epi32(counts, _mm_cmpeq_epi32(ok, ones));
+            }
+            alignas(16) uint32_t lanes[4];
+            _mm_store_si128(reinterpret_cast<__m128i *>(lanes), counts);
+            for (auto lane : lanes)
+                total += lane;
+        }
+#endif
+        for (; x < pixels; ++x) {
+            total += matches(load_pixel(row + size_t(x) * 4), target, tolerance);
+        }
+        return total;
+    }
+
+    // sum of absolute channel differences, `t` has alpha cleared already
+    uint32_t sad_row(const uint8_t *a, const uint8_t *t, int pixels) {
+        uint32_t total = 0;
+        int x = 0;
+#if defined(FRAME_AVX2)
+        {
+            auto mask = _mm256_set1_epi32(int(rgb_mask));
+            auto sums = _mm256_setzero_si256();
+            for (; x + 8 <= pixels; x += 8) {
+                auto p = _mm256_and_si256(_mm256_loadu_si256(reinterpret_cast<const __m256i *>(a + size_t(x) * 4)), mask);
+                auto q = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(t + size_t(x) * 4));
+                sums = _mm256_add_epi64(sums, _mm256_sad_epu8(p, q));
+            }
+            alignas(32) uint64_t lanes[4];
+            _mm256_store_si256(reinterpret_cast<__m256i *>(lanes), sums);
+            total += uint32_t(lanes[0] + lanes[1] + lanes[2] + lanes[3]);
+        }
+#endif
+#if defined(FRAME_SSE2)
+        {
+            auto mask = _mm_set1_epi32(int(rgb_mask));
+            auto sums = _mm_setzero_si128();
+            for (; x + 4 <= pixels; x += 4) {
+                auto p = _mm_and_si128(_mm_loadu_si128(reinterpret_cast<const __m128i *>(a + size_t(x) * 4)), mask);
+                auto q = _mm_loadu_si128(reinterpret_cast<const __m128i *>(t + size_t(x) * 4));
+                sums = _mm_add_epi64(sums, _mm_sad_epu8(p, q));
+            }
+            alignas(16) uint64_t lanes[2];
+            _mm_store_si128(reinterpret_cast<__m128i *>(lanes), sums);
+            total += uint32_t(lanes[0] + lanes[1]);
+        }
+#endif
+        for (; x < pixels; ++x) {
+            for (int c = 0; c < 3; ++c)
+                total += uint32_t(std::abs(int(a[x * 4 + c]) - int(t[x * 4 + c])));
+        }
+        return total;
+    }
+
+    struct products_t {
+        int64_t cross = 0;   // sum of image * template
+        int64_t sum = 0;     // sum of image
+        int64_t squares = 0; // sum of image * image
+    };
+
+    // the sums NCC needs for one window row, `t` has alpha cleared already
+    void products_row(const uint8_t *a, const uint8_t *t, int pixels, products_t &out) {
+        int x = 0;
+#if defined(FRAME_AVX2)
+        {
+            auto mask = _mm256_set1_epi32(int(rgb_mask));
+            auto zero = _mm256_setzero_si256();
+            auto cross = zero, squares = zero, sums = zero;
+            for (; x + 8 <= pixels; x += 8) {
+                auto p = _mm256_and_si256(_mm256_loadu_si256(reinterpret_cast<const __m256i *>(a + size_t(x) * 4)), mask);
+                auto q = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(t + size_t(x) * 4));
+                auto p_lo = _mm256_unpacklo_epi8(p, zero), p_hi = _mm256_unpackhi_epi8(p, zero);
+                auto q_lo = _mm256_unpacklo_epi8(q, zero), q_hi = _mm256_unpackhi_epi8(q, zero);
+                cross = _mm256_add_epi32(cross, _mm256_add_epi32(_mm256_madd_epi16(p_lo, q_lo), _mm256_madd_epi16(p_hi, q_hi)));
+                squares = _mm256_add_epi32(squares, _mm256_add_epi32(_mm256_madd_epi16(p_lo, p_lo), _mm256_madd_epi16(p_hi, p_hi)));
+                sums = _mm256_add_epi64(sums, _mm256_sad_epu8(p, zero));
+            }
+            // every 32 bit lane gains at most 4 * 255 * 255 per 8 pixel step, read as unsigned
+            // it holds 2^32 / 260100 = 16512 steps, so no overflow below ~132k pixels a row
+            alignas(32) uint32_t lanes[8];
+            _mm256_store_si256(reinterpret_cast<__m256i *>(lanes), cross);
+            for (auto lane : lanes)
+                out.cross += lane;
+            _mm256_store_si256(reinterpret_cast<__m256i *>(lanes), squares);
+            for (auto lane : lanes)
+                out.squares += lane;
+            alignas(32) uint64_t wide[4];
+            _mm256_store_si256(reinterpret_cast<__m256i *>(wide), sums);
+            out.sum += int64_t(wide[0] + wide[1] + wide[2] + wide[3]);
+        }
+#endif
+#if defined(FRAME_SSE2)
+        {
+            auto mask = _mm_set1_epi32(int(rgb_mask));
+            auto zero = _mm_setzero_si128();
+            auto cross = zero, squares = zero, sums = zero;
+            for (; x + 4 <= pixels; x += 4) {
+                auto p = _mm_and_si128(_mm_loadu_si128(reinterpret_cast<const __m128i *>(a + size_t(x) * 4)), mask);
+                auto q = _mm_loadu_si128(reinterpret_cast<const __m128i *>(t + size_t(x) * 4));
+                auto p_lo = _mm_unpacklo_epi8(p, zero), p_hi = _mm_unpackhi_epi8(p, zero);
+                auto q_lo = _mm_unpacklo_epi8(q, zero), q_hi = _mm_unpackhi_epi8(q, zero);
+                cross = _mm_add_epi32(cross, _mm_add_epi32(_mm_madd_epi16(p_lo, q_lo), _mm_madd_epi16(p_hi, q_hi)));
+                squares = _mm_add_epi32(squares, _mm_add_epi32(_mm_madd_epi16(p_lo, p_lo), _mm_madd_epi16(p_hi, p_hi)));
+                sums = _mm_add_epi64(sums, _mm_sad_epu8(p, zero));
+            }
+            alignas(16) uint32_t lanes[4];
+            _mm_store_si128(reinterpret_cast<__m128i *>(lanes), cross);
+            for (auto lane : lanes)
+                out.cross += lane;
+            _mm_store_si128(reinterpret_cast<__m128i *>(lanes), squares);
+            for (auto lane : lanes)
+                out.squares += lane;
+            alignas(16) uint64_t wide[2];
+            _mm_store_si128(reinterpret_cast<__m128i *>(wide), sums);
+            out.sum += int64_t(wide[0] + wide[1]);
+        }
+#endif
+        for (; x < pixels; ++x) {
+            for (int c = 0; c < 3; ++c) {
+                int64_t p = a[x * 4 + c], q = t[x * 4 + c];
+                out.cross += p * q;
+                out.sum += p;
+                out.squares += p * p;
+            }
+        }
+    }
+
+    // ignores the alpha byte of every pixel
+    uint32_t tolerance_mask(int tolerance) {
+        auto t = uint32_t(std::clamp(tolerance, 0, 255));
+        return 0xFF000000 | (t << 16) | (t << 8) | t;
+    }
+
+    uint32_t target_pixel(const color &target) {
+        return uint32_t(target.b) | (uint32_t(target.g) << 8) | (uint32_t(target.r) << 16);
+    }
+}
+
+region_search::region_search(ThreadPool *pool, int band_rows) : _pool(pool), _band_rows(std::max(band_rows, 1)) {
+}
+
+void region_search::set_frame(const uint8_t *bits, int width, int height, int pitch) {
+    _bits = bits;
+    _width = width;
+    _height = height;
+    _pitch = pitch;
+}
+
+void region_search::set_frame(frame_source &source) {
+    set_frame(source.bitmap(), source.width(), source.height(), source.pitch());
+}
+
+rect region_search::clip(const rect &area) const {
+    auto x0 = std::max(area.x, 0), y0 = std::max(area.y, 0);
+    auto x1 = std::min(area.x + area.width, _width), y1 = std::min(area.y + area.height, _height);
+    if (_bits == nullptr || x0 >= x1 || y0 >= y1)
+        return rect{};
+    return rect{x0, y0, x1 - x0, y1 - y0};
+}
+
+int region_search::band_height(int rows) const {
+    if (_pool == nullptr)
+        return std::max(rows, 1);
+    // a few bands per worker, so a slow band doesn't hold everyone up
+    auto bands = int(_pool->size()) * 4;
+    return std::max(_band_rows, (rows + bands - 1) / bands);
+}
+
+template <typename F>
+void region_search::for_bands(int y0, int y1, F &&fn) {
+    auto height = band_height(y1 - y0);
+    auto bands = size_t((y1 - y0 + height - 1) / height);
+
+    auto run = [&](size_t begin, size_t end) {
+        for (auto band = begin; band < end; ++band) {
+            auto top = y0 + int(band) * height;
+            fn(band, top, std::min(top + height, y1));
+        }
+    };
+
+    if (bands < 2) {
+        run(0, bands);
+        return;
+    }
+    _pool->parallel_for(bands, 1, run);
+}
+
+bool region_search::find_first(const rect &area, color target, int tolerance, point &found) {
+    auto r = clip(area);
+    if (r.width == 0)
+        return false;
+
+    auto key = target_pixel(target);
+    auto mask = tolerance_mask(tolerance);
+    auto first_x = [&](int y) {
+        int hit = -1;
+        scan_row(_bits + size_t(_pitch) * y + size_t(r.x) * 4, r.width, key, mask, [&](int x) {
+            hit = x;
+            return false;
+        });
+        return hit;
+    };
+
+    // top most row with a hit so far, bands stop once they pass it
+    _first_row.store(r.y + r.height, std::memory_order_relaxed);
+    for_bands(r.y, r.y + r.height, [&](size_t, int y0, int y1) {
+        for (int y = y0; y < y1 && y < _first_row.load(std::memory_order_relaxed); ++y) {
+            if (first_x(y) < 0)
+                continue;
+            auto best = _first_row.load(std::memory_order_relaxed);
+            while (y < best && !_first_row.compare_exchange_weak(best, y, std::memory_order_relaxed)) {
+            }
+            return;
+        }
+    });
+
+    auto y = _first_row.load(std::memory_order_relaxed);
+    if (y >= r.y + r.height)
+        return false;
+
+    // rescanning the winning row is cheaper than racing bands for the x too
+    found = point{r.x + first_x(y), y};
+    return true;
+}
+
+size_t region_search::find_all(const rect &area, color target, int tolerance, std::vector<point> &found, size_t limit) {
+    found.clear();
+    auto r = clip(area);
+    if (r.width == 0 || limit == 0)
+        return 0;
+
+    auto key = target_pixel(target);
+    auto mask = tolerance_mask(tolerance);
+
+    auto height = band_height(r.height);
+    auto bands = size_t((r.height + height - 1) / height);
+    if (_band_points.size() < bands)
+        _band_points.resize(bands);
+
+    for_bands(r.y, r.y + r.height, [&](size_t band, int y0, int y1) {
+        auto &points = _band_points[band];
+        points.clear();
+        for (int y = y0; y < y1 && points.size() < limit; ++y) {
+            scan_row(_bits + size_t(_pitch) * y + size_t(r.x) * 4, r.width, key, mask, [&](int x) {
+                points.push_back(point{r.x + x, y});
+                return points.size() < limit;
+            });
+        }
+    });
+
+    for (size_t band = 0; band < bands && found.size() < limit; ++band) {
+        auto &points = _band_points[band];
+        auto take = std::min(points.size(), limit - found.size());
+        found.insert(found.end(), points.begin(), points.begin() + take);
+    }
+    return found.size();
+}
+
+size_t region_search::count(const rect &area, color target, int tolerance) {
+    auto r = clip(area);
+    if (r.width == 0)
+        return 0;
+
+    auto key = target_pixel(target);
+    auto mask = tolerance_mask(tolerance);
+
+    std::atomic<size_t> total{0};
+    for_bands(r.y, r.y + r.height, [&](size_t, int y0, int y1) {
+        size_t band_total = 0;
+        for (int y = y0; y < y1; ++y) {
+            band_total += count_row(_bits + size_t(_pitch) * y + size_t(r.x) * 4, r.width, key, mask);
+        }
+        total.fetch_add(band_total, std::memory_order_relaxed);
+    });
+    return total.load(std::memory_order_relaxed);
+}
+
+bool region_search::load_template(const uint8_t *bits, int width, int height, int pitch) {
+    if (bits == nullptr || width <= 0 || height <= 0)
+        return false;
+
+    _template.width = width;
+    _template.height = height;
+    _template.bits.resize(size_t(width) * height * 4);
+    _template.sum = 0;
+    _template.sum_squares = 0;
+    for (int y = 0; y < height; ++y) {
+        auto out = &_template.bits[size_t(y) * width * 4];
+        std::memcpy(out, bits + size_t(pitch) * y, size_t(width) * 4);
+        for (int x = 0; x < width; ++x) {
+            out[x * 4 + 3] = 0;
+            for (int c = 0; c < 3; ++c) {
+                _template.sum += out[x * 4 + c];
+                _template.sum_squares += out[x * 4 + c] * out[x * 4 + c];
+            }
+        }
+    }
+    return true;
+}
+
+// the placements whose top left corner is in `area` and whose template fits the frame
+rect region_search::placements(const rect &area) const {
+    auto r = clip(area);
+    r.width = std::min(r.width, _width - _template.width - r.x + 1);
+    r.height = std::min(r.height, _height - _template.height - r.y + 1);
+    if (r.width <= 0 || r.height <= 0)
+        return rect{};
+    return r;
+}
+
+region_search::match region_search::match_sad(const rect &area, const uint8_t *bits, int width, int height, int pitch) {
+    if (!load_template(bits, width, height, pitch))
+        return match{};
+    auto r = placements(area);
+    if (r.width == 0)
+        return match{};
+
+    auto height_band = band_height(r.height);
+    auto bands = size_t((r.height + height_band - 1) / height_band);
+    _band_matches.assign(bands, match{});
+
+    for_bands(r.y, r.y + r.height, [&](size_t band, int y0, int y1) {
+        auto best = UINT32_MAX;
+        auto &result = _band_matches[band];
+        for (int y = y0; y < y1; ++y) {
+            for (int x = r.x; x < r.x + r.width; ++x) {
+                uint32_t sad = 0;
+                // rows are summed until the placement can no longer win
+                for (int ty = 0; ty < _template.height && sad < best; ++ty) {
+                    sad += sad_row(_bits + size_t(_pitch) * (y + ty) + size_t(x) * 4,
+                                   &_template.bits[size_t(ty) * _template.width * 4], _template.width);
+                }
+                if (sad < best) {
+                    best = sad;
+                    result = match{x, y, double(sad)};
+                }
+            }
+        }
+    });
+
+    // bands are in row order, ties go to the first placement
+    match best;
+    for (auto &result : _band_matches) {
+        if (result.x >= 0 && (best.x < 0 || result.score < best.score))
+            best = result;
+    }
+    return best;
+}
+
+region_search::match region_search::match_ncc(const rect &area, const uint8_t *bits, int width, int height, int pitch) {
+    if (!load_template(bits, width, height, pitch))
+        return match{};
+    auto r = placements(area);
+    if (r.width == 0)
+        return match{};
+
+    auto n = double(_template.width) * _template.height * 3;
+    auto template_variance = n * double(_template.sum_squares) - double(_template.sum) * double(_template.sum);
+
+    auto height_band = band_height(r.height);
+    auto bands = size_t((r.height + height_band - 1) / height_band);
+    _band_matches.assign(bands, match{});
+
+    for_bands(r.y, r.y + r.height, [&](size_t band, int y0, int y1) {
+        auto &result = _band_matches[band];
+        for (int y = y0; y < y1; ++y) {
+            for (int x = r.x; x < r.x + r.width; ++x) {
+                products_t sums;
+                for (int ty = 0; ty < _template.height; ++ty) {
+                    products_row(_bits + size_t(_pitch) * (y + ty) + size_t(x) * 4,
+                                 &_template.bits[size_t(ty) * _template.width * 4], _template.width, sums);
+                }
+
+                // a flat window (or template) correlates with nothing
+                auto variance = n * double(sums.squares) - double(sums.sum) * double(sums.sum);
+                auto score = 0.0;
+                if (variance > 0 && template_variance > 0)
+                    score = (n * double(sums.cross) - double(sums.sum) * double(_template.sum)) / std::sqrt(variance * template_variance);
+
+                if (result.x < 0 || score > result.score)
+                    result = match{x, y, score};
+            }
+        }
+    });
+
+    match best;
+    for (auto &result : _band_matches) {
+        if (result.x >= 0 && (best.x < 0 || result.score > best.score))
+            best = result;
+    }
+    return best;
+}
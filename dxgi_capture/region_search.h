@@ -0,0 +1,85 @@
+#pragma once
+
+#include <atomic>
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+#include "frame_source.h"
+
+class ThreadPool;
+
+// Region queries over a BGRA frame, instead of walking it with
+// capture::pixel(): color search and count within a tolerance, and small
+// template matching (SAD / NCC). The kernels work on 8 (AVX2) or 4 (SSE2)
+// pixels per step; with a pool, the rows of a query are split into bands
+// that run in parallel.
+//
+//   region_search search(&pool);
+//   search.set_frame(source);
+//   point hit;
+//   if (search.find_first(area, color(255, 0, 0), 8, hit)) { ... }
+//
+// The frame is borrowed and must not change while a query runs. Queries
+// with a pool must come from one thread at a time (they submit through
+// the pool's first producer).
+class region_search
+{
+public:
+	struct match {
+		int x = -1;
+		int y = -1;
+		double score = 0; // SAD: summed channel differences, lower is better; NCC: -1..1, higher is better
+	};
+
+	// bands are at least `band_rows` rows, so small queries don't pay for a hand off
+	explicit region_search(ThreadPool* pool = nullptr, int band_rows = 32);
+
+	void set_frame(const uint8_t* bits, int width, int height, int pitch);
+	void set_frame(frame_source& source);
+
+	// `tolerance` is the largest difference allowed per channel, alpha is ignored.
+	// Pixels are visited row by row, so the first match is the top most, then left most.
+	bool find_first(const rect& area, color target, int tolerance, point& found);
+	size_t find_all(const rect& area, color target, int tolerance, std::vector<point>& found, size_t limit = SIZE_MAX);
+	size_t count(const rect& area, color target, int tolerance);
+
+	// best placement of a BGRA template whose top left corner lies in `area`
+	// (the template itself may reach past it, never past the frame); x is -1
+	// when it fits nowhere. Alpha is ignored, meant for templates up to ~64x64.
+	match match_sad(const rect& area, const uint8_t* bits, int width, int height, int pitch);
+	match match_ncc(const rect& area, const uint8_t* bits, int width, int height, int pitch);
+
+private:
+	struct template_t {
+		std::vector<uint8_t> bits; // alpha cleared, tightly packed
+		int width = 0;
+		int height = 0;
+		int64_t sum = 0;
+		int64_t sum_squares = 0;
+	};
+
+	rect clip(const rect& area) const;
+	rect placements(const rect& area) const;
+	bool load_template(const uint8_t* bits, int width, int height, int pitch);
+
+	// rows per band, the whole query without a pool
+	int band_height(int rows) const;
+
+	// fn(band, y0, y1) for every band of [y0, y1)
+	template <typename F>
+	void for_bands(int y0, int y1, F&& fn);
+
+	ThreadPool* _pool;
+	int _band_rows;
+
+	const uint8_t* _bits = nullptr;
+	int _width = 0;
+	int _height = 0;
+	int _pitch = 0;
+
+	template_t _template;
+	std::vector<std::vector<point>> _band_points; // per band results, reused across queries
+	std::vector<match> _band_matches;
+	std::atomic<int> _first_row{0};
+};
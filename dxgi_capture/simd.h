@@ -0,0 +1,64 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Instruction set switches for the frame kernels. Everything is chosen at
+// compile time: SSE2 is the x64 baseline, AVX2 needs /arch:AVX2 or -mavx2.
+
+#if defined(__AVX2__) || defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define FRAME_SSE2 1
+#include <emmintrin.h>
+#endif
+
+#if defined(__AVX2__) || defined(__AVX__) || defined(__SSSE3__)
+#define FRAME_SSSE3 1
+#include <tmmintrin.h>
+#endif
+
+#if defined(__AVX2__)
+#define FRAME_AVX2 1
+#include <immintrin.h>
+#endif
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+namespace simd {
+	inline unsigned count_trailing_zeros(uint32_t mask) {
+#if defined(_MSC_VER)
+		unsigned long index;
+		_BitScanForward(&index, mask);
+		return unsigned(index);
+#else
+		return unsigned(__builtin_ctz(mask));
+#endif
+	}
+
+	// true when the `bytes` at `a` and `b` are identical, stops at the first difference
+	inline bool equal(const uint8_t* a, const uint8_t* b, size_t bytes) {
+		size_t i = 0;
+#if defined(FRAME_AVX2)
+		for (; i + 32 <= bytes; i += 32) {
+			auto x = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(a + i));
+			auto y = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(b + i));
+			if (uint32_t(_mm256_movemask_epi8(_mm256_cmpeq_epi8(x, y))) != 0xFFFFFFFFu)
+				return false;
+		}
+#endif
+#if defined(FRAME_SSE2)
+		for (; i + 16 <= bytes; i += 16) {
+			auto x = _mm_loadu_si128(reinterpret_cast<const __m128i*>(a + i));
+			auto y = _mm_loadu_si128(reinterpret_cast<const __m128i*>(b + i));
+			if (_mm_movemask_epi8(_mm_cmpeq_epi8(x, y)) != 0xFFFF)
+				return false;
+		}
+#endif
+		for (; i < bytes; ++i) {
+			if (a[i] != b[i])
+				return false;
+		}
+		return true;
+	}
+}
@@ -0,0 +1,149 @@
+#include "synthetic_source.h"
+
+#include <algorithm>
+#include <cstring>
+#include <thread>
+
+void frame_clock::set_fps(int fps) {
+    _period = fps > 0 ? std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::seconds(1)) / fps
+                      : std::chrono::steady_clock::duration::zero();
+    _next = std::chrono::steady_clock::now();
+}
+
+void frame_clock::wait() {
+    if (_period == std::chrono::steady_clock::duration::zero()) {
+        return;
+    }
+
+    auto now = std::chrono::steady_clock::now();
+    if (now < _next) {
+        std::this_thread::sleep_until(_next);
+        _next += _period;
+    } else if (now - _next > _period) {
+        _next = now + _period;
+    } else {
+        _next += _period;
+    }
+}
+
+synthetic_source::synthetic_source(int width, int height, int fps, pattern kind, int pitch)
+    : _width(std::max(width, 1)), _height(std::max(height, 1)), _pitch(std::max(pitch, _width * 4)), _kind(kind), _clock(fps) {
+    _background.resize(size_t(_width) * _height);
+    for (int y = 0; y < _height; ++y) {
+        for (int x = 0; x < _width; ++x) {
+            // wraps around horizontally, so scrolling has no seam
+            auto b = uint32_t(x * 256 / _width);
+            auto g = uint32_t(y * 256 / _height);
+            auto r = uint32_t((x ^ y) & 0x3F);
+            _background[size_t(y) * _width + x] = 0xFF000000 | (r << 16) | (g << 8) | b;
+        }
+    }
+
+    _data.resize(size_t(_pitch) * _height);
+    restore(rect{0, 0, _width, _height});
+    _box = rect{0, 0, std::min(64, _width), std::min(64, _height)};
+}
+
+void synthetic_source::restore(const rect &area) {
+    for (int y = area.y; y < area.y + area.height; ++y) {
+        std::memcpy(&_data[size_t(y) * _pitch + size_t(area.x) * 4], &_background[size_t(y) * _width + area.x], size_t(area.width) * 4);
+    }
+}
+
+void synthetic_source::fill_box(const rect &area, uint32_t bgra) {
+    for (int y = area.y; y < area.y + area.height; ++y) {
+        auto row = reinterpret_cast<uint32_t *>(&_data[size_t(y) * _pitch]) + area.x;
+        std::fill(row, row + area.width, bgra);
+    }
+}
+
+bool synthetic_source::update() {
+    _clock.wait();
+    ++_frame;
+
+    if (_kind == pattern::scrolling) {
+        auto offset = size_t(_frame * 8 % _width);
+        for (int y = 0; y < _height; ++y) {
+            auto src = &_background[size_t(y) * _width];
+            auto dst = &_data[size_t(y) * _pitch];
+            std::memcpy(dst, src + offset, (_width - offset) * 4);
+            std::memcpy(dst + (_width - offset) * 4, src, offset * 4);
+        }
+        return true;
+    }
+
+    // bounce the box between the edges, 4 pixels per frame on each axis
+    auto bounce = [](uint64_t t, int range) {
+        if (range <= 0)
+            return 0;
+        auto phase = int(t % uint64_t(range * 2));
+        return phase < range ? phase : range * 2 - phase;
+    };
+
+    restore(_box);
+    _box.x = bounce(_frame * 4, _width - _box.width);
+    _box.y = bounce(_frame * 3, _height - _box.height);
+    fill_box(_box, 0xFF000000 | uint32_t(_frame * 0x010307));
+    return true;
+}
+
+bool replay_source::open(const std::string &file_name, bool loop) {
+    _file.open(file_name, std::ios::in | std::ios::binary);
+    if (!_file.good()) {
+        return false;
+    }
+
+    header head;
+    if (!_file.read(reinterpret_cast<char *>(&head), sizeof(head)) || std::memcmp(head.magic, "BGRA", 4) != 0 ||
+        head.width == 0 || head.height == 0) {
+        _file.close();
+        return false;
+    }
+
+    _loop = loop;
+    _width = int(head.width);
+    _height = int(head.height);
+    _clock.set_fps(int(head.fps));
+    _data.resize(size_t(_width) * _height * 4);
+    return true;
+}
+
+bool replay_source::update() {
+    if (!_file.is_open()) {
+        return false;
+    }
+
+    _clock.wait();
+    if (!_file.read(reinterpret_cast<char *>(_data.data()), _data.size())) {
+        if (!_loop) {
+            return false;
+        }
+        _file.clear();
+        _file.seekg(sizeof(header), std::ios::beg);
+        if (!_file.read(reinterpret_cast<char *>(_data.data()), _data.size())) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool replay_source::record(const std::string &file_name, frame_source &source, int frames, int fps) {
+    std::ofstream out(file_name, std::ios::out | std::ios::binary | std::ios::trunc);
+    if (!out.good()) {
+        return false;
+    }
+
+    header head = {{'B', 'G', 'R', 'A'}, uint32_t(source.width()), uint32_t(source.height()), uint32_t(fps)};
+    out.write(reinterpret_cast<const char *>(&head), sizeof(head));
+
+    for (int i = 0; i < frames; ++i) {
+        if (!source.update()) {
+            return false;
+        }
+        auto bits = source.bitmap();
+        for (int y = 0; y < source.height(); ++y) {
+            out.write(reinterpret_cast<const char *>(bits + size_t(y) * source.pitch()), size_t(source.width()) * 4);
+        }
+    }
+    return out.good();
+}
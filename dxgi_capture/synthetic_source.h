@@ -0,0 +1,98 @@
+#pragma once
+
+#include <chrono>
+#include <fstream>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+#include "frame_source.h"
+
+// Sleeps update() down to a fixed frame rate, 0 fps means no pacing.
+// Falling more than a frame behind resyncs instead of bursting to catch up.
+class frame_clock
+{
+public:
+	explicit frame_clock(int fps = 0) { set_fps(fps); }
+
+	void set_fps(int fps);
+	void wait();
+
+private:
+	std::chrono::steady_clock::duration _period{};
+	std::chrono::steady_clock::time_point _next{};
+};
+
+// Generated frames for tests and benchmarks: a static gradient with a
+// bouncing box (little changes per frame, like a cursor or a small
+// animation) or the same gradient scrolling sideways (every pixel changes).
+class synthetic_source : public frame_source
+{
+public:
+	enum class pattern { moving_box, scrolling };
+
+	// pitch 0 means tightly packed rows, a larger pitch pads every row like a mapped texture
+	synthetic_source(int width, int height, int fps = 60, pattern kind = pattern::moving_box, int pitch = 0);
+
+	bool update() override;
+
+	int width() override { return _width; }
+	int height() override { return _height; }
+	int pitch() override { return _pitch; }
+
+	const uint8_t* bitmap() override { return _data.data(); }
+
+	uint64_t frame_index() const { return _frame; }
+
+	// where the box was drawn in the current frame (moving_box only)
+	rect box() const { return _box; }
+
+private:
+	void fill_box(const rect& area, uint32_t bgra);
+	void restore(const rect& area);
+
+	int _width;
+	int _height;
+	int _pitch;
+	pattern _kind;
+	frame_clock _clock;
+
+	std::vector<uint32_t> _background; // one frame, tightly packed
+	std::vector<uint8_t> _data;
+	uint64_t _frame = 0;
+	rect _box;
+};
+
+// Plays back raw BGRA recordings: a 16 byte header ("BGRA", then width,
+// height and fps as uint32) followed by tightly packed frames.
+class replay_source : public frame_source
+{
+public:
+	bool open(const std::string& file_name, bool loop = true);
+
+	// dump `frames` frames of any source into the replay format
+	static bool record(const std::string& file_name, frame_source& source, int frames, int fps);
+
+	bool update() override;
+
+	int width() override { return _width; }
+	int height() override { return _height; }
+	int pitch() override { return _width * 4; }
+
+	const uint8_t* bitmap() override { return _data.data(); }
+
+private:
+	struct header {
+		char magic[4];
+		uint32_t width;
+		uint32_t height;
+		uint32_t fps;
+	};
+
+	std::ifstream _file;
+	bool _loop = true;
+	int _width = 0;
+	int _height = 0;
+	frame_clock _clock;
+	std::vector<uint8_t> _data;
+};
@@ -0,0 +1,143 @@
+#include "tile_diff.h"
+#include "simd.h"
+
+#include <algorithm>
+#include <cstring>
+
+tile_diff::tile_diff(int tile_size) : _tile(std::max(tile_size, 4)) {
+}
+
+void tile_diff::reset() {
+    _width = 0;
+    _height = 0;
+    _previous.clear();
+}
+
+const std::vector<rect> &tile_diff::update(const uint8_t *bits, int width, int height, int pitch) {
+    return diff(bits, width, height, pitch, nullptr);
+}
+
+const std::vector<rect> &tile_diff::update(const uint8_t *bits, int width, int height, int pitch, const std::vector<rect> &hints) {
+    return diff(bits, width, height, pitch, &hints);
+}
+
+const std::vector<rect> &tile_diff::update(frame_source &source) {
+    _hints.clear();
+    auto hinted = source.change_hints(_hints);
+    return diff(source.bitmap(), source.width(), source.height(), source.pitch(), hinted ? &_hints : nullptr);
+}
+
+const std::vector<rect> &tile_diff::diff(const uint8_t *bits, int width, int height, int pitch, const std::vector<rect> *hints) {
+    _dirty.clear();
+    if (width <= 0 || height <= 0) {
+        return _dirty;
+    }
+
+    auto row_bytes = size_t(width) * 4;
+
+    // no reference yet: everything is new
+    if (width != _width || height != _height || _previous.empty()) {
+        _width = width;
+        _height = height;
+        _tiles_x = (width + _tile - 1) / _tile;
+        _tiles_y = (height + _tile - 1) / _tile;
+        _previous.resize(row_bytes * height);
+        for (int y = 0; y < height; ++y) {
+            std::memcpy(&_previous[row_bytes * y], bits + size_t(pitch) * y, row_bytes);
+        }
+        _dirty.push_back(rect{0, 0, width, height});
+        return _dirty;
+    }
+
+    auto tile_count = size_t(_tiles_x) * _tiles_y;
+    _candidates.assign(tile_count, hints ? 0 : 1);
+    _tile_dirty.assign(tile_count, 0);
+
+    if (hints) {
+        for (auto &hint : *hints) {
+            auto x0 = std::max(hint.x, 0), y0 = std::max(hint.y, 0);
+            auto x1 = std::min(hint.x + hint.width, width), y1 = std::min(hint.y + hint.height, height);
+            if (x0 >= x1 || y0 >= y1)
+                continue;
+            for (int ty = y0 / _tile; ty <= (y1 - 1) / _tile; ++ty) {
+                std::fill_n(&_candidates[size_t(ty) * _tiles_x + x0 / _tile], (x1 - 1) / _tile - x0 / _tile + 1, uint8_t(1));
+            }
+        }
+    }
+
+    for (int ty = 0; ty < _tiles_y; ++ty) {
+        auto candidates = &_candidates[size_t(ty) * _tiles_x];
+        auto tile_dirty = &_tile_dirty[size_t(ty) * _tiles_x];
+        if (std::find(candidates, candidates + _tiles_x, uint8_t(1)) == candidates + _tiles_x)
+            continue;
+
+        auto y0 = ty * _tile;
+        auto y1 = std::min(y0 + _tile, height);
+
+        // walk the band row by row so both frames stream through memory in order
+        for (int y = y0; y < y1; ++y) {
+            auto current = bits + size_t(pitch) * y;
+            auto previous = &_previous[row_bytes * y];
+            for (int tx = 0; tx < _tiles_x; ++tx) {
+                if (!candidates[tx] || tile_dirty[tx])
+                    continue;
+                auto x0 = size_t(tx) * _tile * 4;
+                auto bytes = std::min(size_t(_tile) * 4, row_bytes - x0);
+                tile_dirty[tx] = !simd::equal(current + x0, previous + x0, bytes);
+            }
+        }
+
+        // refresh the reference, dirty tiles only
+        for (int tx = 0; tx < _tiles_x; ++tx) {
+            if (!tile_dirty[tx])
+                continue;
+            auto x0 = size_t(tx) * _tile * 4;
+            auto bytes = std::min(size_t(_tile) * 4, row_bytes - x0);
+            for (int y = y0; y < y1; ++y) {
+                std::memcpy(&_previous[row_bytes * y + x0], bits + size_t(pitch) * y + x0, bytes);
+            }
+        }
+    }
+
+    merge();
+    return _dirty;
+}
+
+// runs of dirty tiles in a tile row become one rect, and a rect grows
+// downwards while the row below has a run with exactly the same span
+void tile_diff::merge() {
+    _open.clear(); // rects ending on the previous tile row, left to right
+
+    for (int ty = 0; ty < _tiles_y; ++ty) {
+        auto tile_dirty = &_tile_dirty[size_t(ty) * _tiles_x];
+        auto y0 = ty * _tile;
+        auto y1 = std::min(y0 + _tile, _height);
+
+        _next_open.clear();
+        size_t search = 0;
+        for (int tx = 0; tx < _tiles_x;) {
+            if (!tile_dirty[tx]) {
+                ++tx;
+                continue;
+            }
+
+            auto x0 = tx * _tile;
+            while (tx < _tiles_x && tile_dirty[tx])
+                ++tx;
+            auto x1 = std::min(tx * _tile, _width);
+
+            // runs come left to right, so the scan over open rects only moves forward
+            while (search < _open.size() && _dirty[_open[search]].x < x0)
+                ++search;
+
+            if (search < _open.size() && _dirty[_open[search]].x == x0 && _dirty[_open[search]].width == x1 - x0) {
+                _dirty[_open[search]].height = y1 - _dirty[_open[search]].y;
+                _next_open.push_back(_open[search++]);
+            } else {
+                _dirty.push_back(rect{x0, y0, x1 - x0, y1 - y0});
+                _next_open.push_back(_dirty.size() - 1);
+            }
+        }
+        _open.swap(_next_open);
+    }
+}
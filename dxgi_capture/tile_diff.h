@@ -0,0 +1,54 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+#include "frame_source.h"
+
+// Finds what changed between consecutive frames. The frame is cut into
+// square tiles, each tile is compared with the previous frame row by row
+// (AVX2 / SSE2, stopping at the first differing row), and dirty tiles are
+// merged into rectangles. Only dirty tiles are copied into the reference
+// frame, so both the compare and the bookkeeping cost follow the change.
+//
+// With hints (DXGI dirty / move rects) only the tiles they touch are
+// compared; everything else is taken as unchanged.
+class tile_diff
+{
+public:
+	// 16 for fine grained rects (cursor sized), 64 for fewer, larger ones
+	explicit tile_diff(int tile_size = 64);
+
+	// diff against the previous frame; the first frame, or a new size, is all dirty
+	const std::vector<rect>& update(const uint8_t* bits, int width, int height, int pitch);
+	const std::vector<rect>& update(const uint8_t* bits, int width, int height, int pitch, const std::vector<rect>& hints);
+
+	// uses the source's change hints when it has them
+	const std::vector<rect>& update(frame_source& source);
+
+	const std::vector<rect>& dirty() const { return _dirty; }
+
+	// forget the reference frame, the next update reports everything
+	void reset();
+
+	int tile_size() const { return _tile; }
+
+private:
+	const std::vector<rect>& diff(const uint8_t* bits, int width, int height, int pitch, const std::vector<rect>* hints);
+	void merge();
+
+	int _tile;
+	int _width = 0;
+	int _height = 0;
+	int _tiles_x = 0;
+	int _tiles_y = 0;
+
+	std::vector<uint8_t> _previous;   // reference frame, tightly packed
+	std::vector<uint8_t> _candidates; // per tile, touched by a hint
+	std::vector<uint8_t> _tile_dirty; // per tile, result of the last diff
+	std::vector<rect> _hints;
+	std::vector<rect> _dirty;
+	std::vector<size_t> _open;      // merge() scratch
+	std::vector<size_t> _next_open;
+};
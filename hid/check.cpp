@@ -0,0 +1,161 @@
+// Checks for ReportDescriptor against real descriptors, run them under the sanitizers:
+//
+//   g++ -std=c++17 -g -fsanitize=address,undefined check.cpp report_descriptor.cpp -o check && ./check
+//
+// Prints the failed checks and exits with 1 if there are any.
+
+#include "report_descriptor.h"
+
+#include <cstdio>
+
+namespace {
+    int failures = 0;
+
+    void check(bool ok, const char *what, int line) {
+        if (!ok) {
+            std::fprintf(stderr, "line %d: %s\n", line, what);
+            ++failures;
+        }
+    }
+
+#define CHECK(expr) check((expr), #expr, __LINE__)
+
+    template <size_t N>
+    bool equals(const int64_t *values, const int64_t (&expected)[N]) {
+        for (size_t i = 0; i < N; ++i) {
+            if (values[i] != expected[i])
+                return false;
+        }
+        return true;
+    }
+
+    // HID 1.11 appendix B.2, no report ids: 3 buttons, 5 bits padding, 8 bit X and Y
+    const uint8_t boot_mouse[] = {
+        0x05, 0x01, 0x09, 0x02, 0xA1, 0x01, 0x09, 0x01, 0xA1, 0x00,
+        0x05, 0x09, 0x19, 0x01, 0x29, 0x03, 0x15, 0x00, 0x25, 0x01, 0x95, 0x03, 0x75, 0x01, 0x81, 0x02,
+        0x95, 0x01, 0x75, 0x05, 0x81, 0x01,
+        0x05, 0x01, 0x09, 0x30, 0x09, 0x31, 0x15, 0x81, 0x25, 0x7F, 0x75, 0x08, 0x95, 0x02, 0x81, 0x06,
+        0xC0, 0xC0,
+    };
+
+    // HID 1.11 appendix B.1: 8 modifier bits, a reserved byte, 6 key slots; 5 LEDs out
+    const uint8_t boot_keyboard[] = {
+        0x05, 0x01, 0x09, 0x06, 0xA1, 0x01,
+        0x05, 0x07, 0x19, 0xE0, 0x29, 0xE7, 0x15, 0x00, 0x25, 0x01, 0x75, 0x01, 0x95, 0x08, 0x81, 0x02,
+        0x95, 0x01, 0x75, 0x08, 0x81, 0x01,
+        0x95, 0x05, 0x75, 0x01, 0x05, 0x08, 0x19, 0x01, 0x29, 0x05, 0x91, 0x02,
+        0x95, 0x01, 0x75, 0x03, 0x91, 0x01,
+        0x95, 0x06, 0x75, 0x08, 0x15, 0x00, 0x25, 0x65, 0x05, 0x07, 0x19, 0x00, 0x29, 0x65, 0x81, 0x00,
+        0xC0,
+    };
+
+    // report id 2: 5 buttons, 12 bit signed X and Y, 8 bit wheel;
+    // feature id 5 (inside push / pop): three 16 bit and one 32 bit unsigned value
+    const uint8_t id_mouse[] = {
+        0x05, 0x01, 0x09, 0x02, 0xA1, 0x01, 0x85, 0x02, 0x09, 0x01, 0xA1, 0x00,
+        0x05, 0x09, 0x19, 0x01, 0x29, 0x05, 0x15, 0x00, 0x25, 0x01, 0x95, 0x05, 0x75, 0x01, 0x81, 0x02,
+        0x95, 0x01, 0x75, 0x03, 0x81, 0x03,
+        0x05, 0x01, 0x16, 0x01, 0xF8, 0x26, 0xFF, 0x07, 0x75, 0x0C, 0x95, 0x02, 0x09, 0x30, 0x09, 0x31, 0x81, 0x06,
+        0x15, 0x81, 0x25, 0x7F, 0x75, 0x08, 0x95, 0x01, 0x09, 0x38, 0x81, 0x06, 0xC0,
+        0xA4, 0x06, 0x00, 0xFF, 0x85, 0x05, 0x09, 0x01, 0x15, 0x00, 0x27, 0xFF, 0xFF, 0x00, 0x00, 0x75, 0x10, 0x95, 0x03, 0xB1, 0x02,
+        0x75, 0x20, 0x95, 0x01, 0x17, 0x00, 0x00, 0x00, 0x00, 0x27, 0xFF, 0xFF, 0xFF, 0xFF, 0x09, 0x02, 0xB1, 0x02, 0xB4,
+        0xC0,
+    };
+
+    void mouse() {
+        ReportDescriptor descriptor;
+        CHECK(descriptor.parse(boot_mouse, sizeof(boot_mouse)));
+        CHECK(!descriptor.uses_report_ids());
+        CHECK(descriptor.reports().size() == 1 && descriptor.max_field_count() == 5);
+
+        auto &fields = descriptor.fields();
+        CHECK(fields.size() == 5);
+        CHECK(fields[0].usage == 0x00090001 && fields[2].usage == 0x00090003 && fields[2].bit_offset == 2);
+        CHECK(fields[3].usage == 0x00010030 && fields[3].bit_offset == 8 && fields[3].is_signed());
+        CHECK(fields[4].usage == 0x00010031 && fields[4].bit_offset == 16);
+
+        // buttons 1 and 3, X -5, Y 16
+        const uint8_t report[] = {0x05, 0xFB, 0x10};
+        int64_t values[5];
+        auto found = descriptor.extract(ReportType::input, report, sizeof(report), values, 5);
+        CHECK(found != nullptr && found->bytes == 3 && found->field_count == 5);
+        CHECK(equals(values, {1, 0, 1, -5, 16}));
+
+        CHECK(descriptor.extract(ReportType::input, report, 2, values, 5) == nullptr);
+        CHECK(descriptor.extract(ReportType::input, report, sizeof(report), values, 4) == nullptr);
+        CHECK(descriptor.extract(ReportType::output, report, sizeof(report), values, 5) == nullptr);
+    }
+
+    void keyboard() {
+        ReportDescriptor descriptor;
+        CHECK(descriptor.parse(boot_keyboard, sizeof(boot_keyboard)));
+        CHECK(descriptor.max_field_count() == 14);
+
+        // the reserved byte is padding, the key slots are an array of indices from usage 0
+        auto &fields = descriptor.fields();
+        CHECK(fields[0].usage == 0x000700E0 && fields[7].usage == 0x000700E7);
+        CHECK(fields[8].usage == 0x00070000 && fields[8].bit_offset == 16 && !(fields[8].flags & ReportField::variable));
+
+        // left shift and right alt, keys a and b
+        const uint8_t input[] = {0x42, 0x00, 0x04, 0x05, 0x00, 0x00, 0x00, 0x00};
+        int64_t values[14];
+        auto found = descriptor.extract(ReportType::input, input, sizeof(input), values, 14);
+        CHECK(found != nullptr && found->bytes == 8 && found->field_count == 14);
+        CHECK(equals(values, {0, 1, 0, 0, 0, 0, 1, 0, 4, 5, 0, 0, 0, 0}));
+
+        // num lock and caps lock
+        const uint8_t output[] = {0x03};
+        found = descriptor.extract(ReportType::output, output, sizeof(output), values, 14);
+        CHECK(found != nullptr && found->field_count == 5 && fields[found->first_field].usage == 0x00080001);
+        CHECK(equals(values, {1, 1, 0, 0, 0}));
+    }
+
+    void report_ids() {
+        ReportDescriptor descriptor;
+        CHECK(descriptor.parse(id_mouse, sizeof(id_mouse)));
+        CHECK(descriptor.uses_report_ids());
+        CHECK(descriptor.reports().size() == 2 && descriptor.max_field_count() == 8);
+
+        auto input = descriptor.find(ReportType::input, 2);
+        CHECK(input != nullptr && input->bytes == 6 && input->field_count == 8);
+        auto &x = descriptor.fields()[input->first_field + 5];
+        CHECK(x.usage == 0x00010030 && x.bit_offset == 16 && x.bit_size == 12 && x.logical_min == -2047 && x.logical_max == 2047);
+
+        // buttons 1 and 3, X -5 and Y 100 packed into 3 bytes, wheel -1
+        uint32_t xy = (uint32_t(-5) & 0xFFF) | 100u << 12;
+        const uint8_t report[] = {0x02, 0x05, uint8_t(xy), uint8_t(xy >> 8), uint8_t(xy >> 16), 0xFF};
+        int64_t values[8];
+        CHECK(descriptor.extract(ReportType::input, report, sizeof(report), values, 8) == input);
+        CHECK(equals(values, {1, 0, 1, 0, 0, -5, 100, -1}));
+
+        // the extremes of a 12 bit field
+        xy = 0x801 | 0x7FFu << 12;
+        const uint8_t edges[] = {0x02, 0x00, uint8_t(xy), uint8_t(xy >> 8), uint8_t(xy >> 16), 0x80};
+        CHECK(descriptor.extract(ReportType::input, edges, sizeof(edges), values, 8) == input);
+        CHECK(values[5] == -2047 && values[6] == 2047 && values[7] == -128);
+
+        const uint8_t unknown[] = {0x03, 0, 0, 0, 0, 0};
+        CHECK(descriptor.extract(ReportType::input, unknown, sizeof(unknown), values, 8) == nullptr);
+        CHECK(descriptor.extract(ReportType::input, report, sizeof(report) - 1, values, 8) == nullptr);
+
+        // the feature report keeps its own usage page and id after the pop, values wider than 16 bits stay unsigned
+        const uint8_t feature[] = {0x05, 0x34, 0x12, 0xFF, 0xFF, 0x00, 0x80, 0xFF, 0xFF, 0xFF, 0xFF};
+        auto found = descriptor.extract(ReportType::feature, feature, sizeof(feature), values, 8);
+        CHECK(found != nullptr && found->id == 5 && found->field_count == 4);
+        CHECK(descriptor.fields()[found->first_field].usage == 0xFF000001);
+        CHECK(equals(values, {0x1234, 0xFFFF, 0x8000, 0xFFFFFFFF}));
+    }
+}
+
+int main() {
+    mouse();
+    keyboard();
+    report_ids();
+
+    if (failures != 0) {
+        std::fprintf(stderr, "%d checks failed\n", failures);
+        return 1;
+    }
+    std::printf("ok\n");
+    return 0;
+}
@@ -142,9 +142,17 @@ bool HID::read(const Device &device, BYTE *data, int length) {
             data,
             length,
             0,
-            &overlapped);
+            &overlapped) || GetLastError() == ERROR_IO_PENDING;
 
-        WaitForSingleObject(event_handle, 500);
+        // the read must be over before `overlapped` and the event go away
+        if (Out && WaitForSingleObject(event_handle, 500) != WAIT_OBJECT_0) {
+            CancelIoEx(device.device_handle, &overlapped);
+        }
+
+        DWORD count = 0;
+        Out = Out && GetOverlappedResult(device.device_handle, &overlapped, &count, true);
+
+        CloseHandle(event_handle);
 
         return Out;
     }
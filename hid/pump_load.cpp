@@ -0,0 +1,101 @@
+// Load test for ReportPump over LoopbackTransport, meant to run under ThreadSanitizer:
+//
+//   g++ -std=c++17 -O1 -g -fsanitize=thread pump_load.cpp report_pump.cpp transport.cpp -o pump_load -pthread
+//   pump_load [reports] [device_queue]
+//
+// A device thread injects numbered reports as fast as it can while a writer
+// thread sends output reports, which the loopback returns as input, and the
+// consumer takes batches. Every report must arrive in order or be counted
+// as dropped by the device queue. Exits with 1 on a failure.
+
+#include "report_pump.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <thread>
+
+namespace {
+    constexpr size_t report_length = 9; // id byte, sequence number, padding
+    constexpr uint8_t device_id = 1;
+    constexpr uint8_t writer_id = 2;
+    constexpr uint32_t writes = 10000;
+
+    uint32_t sequence(const uint8_t *report) {
+        uint32_t value;
+        std::memcpy(&value, report + 1, sizeof(value));
+        return value;
+    }
+}
+
+int main(int argc, char **argv) {
+    uint32_t reports = argc > 1 ? uint32_t(std::strtoul(argv[1], nullptr, 10)) : 200000;
+    size_t device_queue = argc > 2 ? std::strtoul(argv[2], nullptr, 10) : 4096;
+
+    LoopbackTransport transport(report_length, device_queue, 16);
+    ReportPump pump(transport, 4, 8, 16);
+    pump.start();
+
+    std::thread device([&] {
+        uint8_t report[report_length] = {device_id};
+        for (uint32_t i = 0; i < reports; ++i) {
+            std::memcpy(report + 1, &i, sizeof(i));
+            transport.inject(report, report_length);
+        }
+    });
+
+    std::atomic<uint32_t> written{0};
+    std::thread writer([&] {
+        uint8_t data[report_length - 1] = {};
+        for (uint32_t i = 0; i < writes; ++i) {
+            std::memcpy(data, &i, sizeof(i));
+            if (!pump.write(writer_id, data, sizeof(data))) {
+                return;
+            }
+            written.fetch_add(1, std::memory_order_relaxed);
+        }
+    });
+
+    // sequence numbers only grow per source, gaps are drops
+    int64_t last[3] = {-1, -1, -1};
+    uint64_t received = 0;
+    bool ok = true;
+    ReportBatch batch;
+    while (ok && pump.poll(batch, std::chrono::milliseconds(500))) {
+        for (size_t i = 0; i < batch.count; ++i) {
+            auto report = batch.report(i);
+            auto id = report[0];
+            if (id != device_id && id != writer_id) {
+                std::fprintf(stderr, "report with id %d\n", id);
+                ok = false;
+                break;
+            }
+            if (int64_t(sequence(report)) <= last[id]) {
+                std::fprintf(stderr, "id %d: %u after %lld\n", id, sequence(report), (long long)last[id]);
+                ok = false;
+                break;
+            }
+            last[id] = sequence(report);
+            ++received;
+        }
+        pump.release(batch);
+    }
+
+    device.join();
+    writer.join();
+    pump.stop();
+
+    auto sent = uint64_t(reports) + written.load();
+    std::printf("%llu sent, %llu received, %llu dropped, %llu stalls\n", (unsigned long long)sent,
+                (unsigned long long)received, (unsigned long long)transport.dropped(), (unsigned long long)pump.stalls());
+    if (written.load() != writes) {
+        std::fprintf(stderr, "%u of %u writes failed\n", writes - written.load(), writes);
+        ok = false;
+    }
+    if (received + transport.dropped() != sent) {
+        std::fprintf(stderr, "%llu reports lost without being counted\n", (unsigned long long)(sent - received - transport.dropped()));
+        ok = false;
+    }
+    std::printf("%s\n", ok ? "ok" : "FAILED");
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,308 @@
+#include "report_descriptor.h"
+
+#include <algorithm>
+#include <cstring>
+
+namespace {
+    // item tags, HID 1.11 section 6.2.2
+    enum : uint8_t {
+        main_input = 0x8,
+        main_output = 0x9,
+        main_collection = 0xA,
+        main_feature = 0xB,
+        main_end_collection = 0xC,
+
+        global_usage_page = 0x0,
+        global_logical_min = 0x1,
+        global_logical_max = 0x2,
+        global_report_size = 0x7,
+        global_report_id = 0x8,
+        global_report_count = 0x9,
+        global_push = 0xA,
+        global_pop = 0xB,
+
+        local_usage = 0x0,
+        local_usage_min = 0x1,
+        local_usage_max = 0x2,
+    };
+
+    constexpr uint8_t long_item = 0xFE;
+    constexpr size_t max_stack = 8;
+    constexpr uint32_t max_report_bits = 8192 * 8;
+
+    struct Globals {
+        uint32_t usage_page = 0;
+        int64_t logical_min = 0;
+        int64_t logical_max = 0;       // as signed
+        uint32_t logical_max_bits = 0; // as unsigned, for ranges that start at 0 or above
+        uint32_t report_size = 0;
+        uint32_t report_count = 0;
+        uint8_t report_id = 0;
+    };
+
+    struct Locals {
+        std::vector<uint32_t> usages;
+        uint32_t usage_min = 0;
+        uint32_t usage_max = 0;
+        bool have_min = false;
+        bool have_max = false;
+
+        void clear() {
+            usages.clear();
+            have_min = have_max = false;
+        }
+
+        bool empty() const { return usages.empty() && !have_min; }
+
+        // usage of the n-th value, the last one repeats when there are fewer usages than values
+        uint32_t at(uint32_t n) const {
+            if (!usages.empty())
+                return usages[std::min<size_t>(n, usages.size() - 1)];
+            if (!have_min)
+                return 0;
+            auto last = have_max && usage_max >= usage_min ? usage_max - usage_min : 0;
+            return usage_min + std::min(n, last);
+        }
+    };
+
+    // a usage of one or two bytes is completed by the usage page in effect
+    uint32_t full_usage(uint32_t value, size_t length, const Globals &globals) {
+        return length == 4 ? value : globals.usage_page << 16 | (value & 0xFFFF);
+    }
+
+    inline int64_t decode(const uint8_t *window, uint8_t shift, uint8_t left, uint64_t mask) {
+        uint64_t word;
+        std::memcpy(&word, window, 8); // reports are little endian, like the hosts this runs on
+        auto value = static_cast<int64_t>((word >> shift) << left) >> left;
+        return static_cast<int64_t>(static_cast<uint64_t>(value) & mask);
+    }
+}
+
+void ReportDescriptor::clear() {
+    m_fields.clear();
+    m_extractors.clear();
+    m_reports.clear();
+    m_lookup.assign(3 * 256, -1);
+    m_max_field_count = 0;
+    m_uses_ids = false;
+}
+
+bool ReportDescriptor::parse(const uint8_t *data, size_t size) {
+    clear();
+
+    Globals globals;
+    Globals stack[max_stack];
+    size_t depth = 0;
+    size_t collections = 0;
+    Locals locals;
+    std::vector<uint32_t> bits(3 * 256, 0); // per type and report id
+
+    auto fail = [&] {
+        clear();
+        return false;
+    };
+
+    size_t i = 0;
+    while (i < size) {
+        auto prefix = data[i++];
+        if (prefix == long_item) {
+            // no long items are defined, skip the data
+            if (size - i < 2 || size - i - 2 < data[i])
+                return fail();
+            i += 2 + data[i];
+            continue;
+        }
+
+        size_t length = prefix & 3;
+        if (length == 3)
+            length = 4;
+        if (size - i < length)
+            return fail();
+
+        uint32_t value = 0;
+        for (size_t k = 0; k < length; ++k)
+            value |= uint32_t(data[i + k]) << (8 * k);
+        auto signed_value = length == 0 ? 0 : int64_t(int32_t(value << (32 - 8 * length)) >> (32 - 8 * length));
+        i += length;
+
+        auto tag = uint8_t(prefix >> 4);
+        switch ((prefix >> 2) & 3) {
+        case 0: // main
+            if (tag == main_input || tag == main_output || tag == main_feature) {
+                auto type = tag == main_input ? ReportType::input : tag == main_output ? ReportType::output : ReportType::feature;
+                auto &offset = bits[size_t(type) * 256 + globals.report_id];
+                auto flags = uint8_t(value);
+
+                uint64_t total = uint64_t(globals.report_size) * globals.report_count;
+                if (offset + total > max_report_bits)
+                    return fail();
+
+                // constants without usages are padding, wider values are opaque blobs
+                if (globals.report_size >= 1 && globals.report_size <= 32 && !((flags & ReportField::constant) && locals.empty())) {
+                    auto min = globals.logical_min;
+                    auto max = min < 0 ? globals.logical_max : int64_t(globals.logical_max_bits);
+                    for (uint32_t n = 0; n < globals.report_count; ++n) {
+                        ReportField field;
+                        field.usage = locals.at(flags & ReportField::variable ? n : 0);
+                        field.bit_offset = offset + n * globals.report_size;
+                        field.bit_size = uint8_t(globals.report_size);
+                        field.report_id = globals.report_id;
+                        field.type = type;
+                        field.flags = flags;
+                        field.logical_min = min;
+                        field.logical_max = max;
+                        m_fields.push_back(field);
+                    }
+                }
+                offset += uint32_t(total);
+            } else if (tag == main_collection) {
+                ++collections;
+            } else if (tag == main_end_collection) {
+                if (collections == 0)
+                    return fail();
+                --collections;
+            }
+            locals.clear();
+            break;
+
+        case 1: // global
+            switch (tag) {
+            case global_usage_page:
+                globals.usage_page = value & 0xFFFF;
+                break;
+            case global_logical_min:
+                globals.logical_min = signed_value;
+                break;
+            case global_logical_max:
+                globals.logical_max = signed_value;
+                globals.logical_max_bits = value;
+                break;
+            case global_report_size:
+                globals.report_size = value;
+                break;
+            case global_report_id:
+                if (value == 0 || value > 255)
+                    return fail();
+                globals.report_id = uint8_t(value);
+                m_uses_ids = true;
+                break;
+            case global_report_count:
+                globals.report_count = value;
+                break;
+            case global_push:
+                if (depth == max_stack)
+                    return fail();
+                stack[depth++] = globals;
+                break;
+            case global_pop:
+                if (depth == 0)
+                    return fail();
+                globals = stack[--depth];
+                break;
+            }
+            break;
+
+        case 2: // local
+            switch (tag) {
+            case local_usage:
+                locals.usages.push_back(full_usage(value, length, globals));
+                break;
+            case local_usage_min:
+                locals.usage_min = full_usage(value, length, globals);
+                locals.have_min = true;
+                break;
+            case local_usage_max:
+                locals.usage_max = full_usage(value, length, globals);
+                locals.have_max = true;
+                break;
+            }
+            break;
+
+        default: // reserved
+            break;
+        }
+    }
+
+    // with report ids every report starts with its id byte
+    if (m_uses_ids) {
+        for (auto &field : m_fields)
+            field.bit_offset += 8;
+    }
+
+    std::stable_sort(m_fields.begin(), m_fields.end(), [](const ReportField &a, const ReportField &b) {
+        if (a.type != b.type)
+            return a.type < b.type;
+        if (a.report_id != b.report_id)
+            return a.report_id < b.report_id;
+        return a.bit_offset < b.bit_offset;
+    });
+
+    // the fields are in (type, id) order now, the same order the reports are listed in
+    uint32_t next = 0;
+    for (size_t slot = 0; slot < bits.size(); ++slot) {
+        if (bits[slot] == 0)
+            continue;
+
+        Report report;
+        report.type = ReportType(slot / 256);
+        report.id = uint8_t(slot % 256);
+        report.bytes = (bits[slot] + 7) / 8 + (m_uses_ids ? 1 : 0);
+        report.first_field = next;
+        report.fast_count = 0;
+        while (next < m_fields.size() && m_fields[next].type == report.type && m_fields[next].report_id == report.id) {
+            if (m_fields[next].bit_offset / 8 + 8 <= report.bytes)
+                ++report.fast_count;
+            ++next;
+        }
+        report.field_count = next - report.first_field;
+        m_max_field_count = std::max<size_t>(m_max_field_count, report.field_count);
+
+        m_lookup[slot] = int32_t(m_reports.size());
+        m_reports.push_back(report);
+    }
+
+    m_extractors.reserve(m_fields.size());
+    for (auto &field : m_fields) {
+        Extractor extractor;
+        extractor.byte = field.bit_offset / 8;
+        extractor.shift = uint8_t(field.bit_offset % 8);
+        extractor.left = uint8_t(64 - field.bit_size);
+        extractor.mask = field.is_signed() ? ~uint64_t(0) : (uint64_t(1) << field.bit_size) - 1;
+        m_extractors.push_back(extractor);
+    }
+    return true;
+}
+
+const Report *ReportDescriptor::find(ReportType type, uint8_t id) const {
+    if (m_lookup.empty())
+        return nullptr;
+    auto index = m_lookup[size_t(type) * 256 + id];
+    return index < 0 ? nullptr : &m_reports[size_t(index)];
+}
+
+const Report *ReportDescriptor::extract(ReportType type, const uint8_t *data, size_t length, int64_t *values, size_t max_values) const {
+    if (length == 0)
+        return nullptr;
+    auto report = find(type, m_uses_ids ? data[0] : 0);
+    if (report == nullptr || length < report->bytes || report->field_count > max_values)
+        return nullptr;
+
+    auto extractors = m_extractors.data() + report->first_field;
+    uint32_t n = 0;
+    for (; n < report->fast_count; ++n) {
+        auto &e = extractors[n];
+        values[n] = decode(data + e.byte, e.shift, e.left, e.mask);
+    }
+
+    if (n < report->field_count) {
+        // the last fields would read past the report, they read a padded copy of its end instead
+        uint8_t tail[16] = {};
+        auto start = report->bytes > 8 ? report->bytes - 8 : 0;
+        std::memcpy(tail, data + start, report->bytes - start);
+        for (; n < report->field_count; ++n) {
+            auto &e = extractors[n];
+            values[n] = decode(tail + (e.byte - start), e.shift, e.left, e.mask);
+        }
+    }
+    return report;
+}
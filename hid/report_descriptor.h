@@ -0,0 +1,93 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+enum class ReportType : uint8_t {
+    input,
+    output,
+    feature,
+};
+
+// One value in a report. Array items (keyboards' key codes) become one
+// field per slot, with `usage` the first usage of the array and the value
+// an index into it.
+struct ReportField {
+    uint32_t usage;       // usage page << 16 | usage id
+    uint32_t bit_offset;  // from the start of the report, the id byte included when there is one
+    uint8_t bit_size;     // 1 to 32
+    uint8_t report_id;
+    ReportType type;
+    uint8_t flags;        // data bits of the main item, see constant / variable / relative
+    int64_t logical_min;
+    int64_t logical_max;
+
+    static constexpr uint8_t constant = 0x01;
+    static constexpr uint8_t variable = 0x02;
+    static constexpr uint8_t relative = 0x04;
+
+    bool is_signed() const { return logical_min < 0; }
+};
+
+struct Report {
+    ReportType type;
+    uint8_t id;          // 0 when the descriptor has no report ids
+    uint32_t bytes;      // length of the report, the id byte included
+    uint32_t first_field;
+    uint32_t field_count;
+    uint32_t fast_count; // fields whose 8 byte window fits inside the report
+};
+
+// Compiles a raw HID report descriptor into flat tables, so reports can be
+// decoded without HidP_* calls or the preparsed data, on any platform.
+//
+//   ReportDescriptor descriptor;
+//   descriptor.parse(bytes, size);
+//   std::vector<int64_t> values(descriptor.max_field_count());
+//   if (auto report = descriptor.extract(ReportType::input, data, length, values.data(), values.size()))
+//       for (size_t i = 0; i < report->field_count; ++i)
+//           ...descriptor.fields()[report->first_field + i], values[i]...
+//
+// Reports are passed the way the device sends them: starting with the
+// report id byte when the descriptor uses ids, without it otherwise. Windows
+// buffers always start with an id byte, pass them from data + 1 when
+// uses_report_ids() is false.
+class ReportDescriptor {
+public:
+    // false on a malformed descriptor, the tables are empty then
+    bool parse(const uint8_t *data, size_t size);
+
+    const std::vector<ReportField> &fields() const { return m_fields; }
+    const std::vector<Report> &reports() const { return m_reports; }
+
+    bool uses_report_ids() const { return m_uses_ids; }
+
+    // most fields in any one report, enough room for extract() on every report
+    size_t max_field_count() const { return m_max_field_count; }
+
+    const Report *find(ReportType type, uint8_t id) const;
+
+    // decode every field of one report into `values` (field_count of them,
+    // in the order of fields()), nullptr for an unknown or short report or
+    // when its fields do not fit in `max_values`
+    const Report *extract(ReportType type, const uint8_t *data, size_t length, int64_t *values, size_t max_values) const;
+
+private:
+    // how to pull one field out, precomputed so decoding has no branches
+    struct Extractor {
+        uint32_t byte;  // first byte of the 8 byte window
+        uint8_t shift;  // bit of the field inside the window
+        uint8_t left;   // 64 - bit_size
+        uint64_t mask;  // all ones for signed fields, the field bits for unsigned ones
+    };
+
+    void clear();
+
+    std::vector<ReportField> m_fields;
+    std::vector<Extractor> m_extractors;
+    std::vector<Report> m_reports;
+    std::vector<int32_t> m_lookup; // 3 * 256 indices into m_reports, -1 if absent
+    size_t m_max_field_count = 0;
+    bool m_uses_ids = false;
+};
@@ -0,0 +1,138 @@
+#include "report_pump.h"
+
+#include <algorithm>
+#include <cstring>
+
+ReportPump::ReportPump(Transport &transport, size_t reads_in_flight, size_t reports_per_read, size_t chunks)
+    : m_transport(transport),
+      m_in_flight(std::max<size_t>(std::min(reads_in_flight, transport.max_reads()), 1)),
+      m_chunks(std::max(chunks, m_in_flight)),
+      m_chunk_bytes(transport.input_length() * std::max<size_t>(reports_per_read, 1)),
+      m_ring(m_chunks * m_chunk_bytes),
+      m_lengths(m_chunks),
+      m_transferred(m_in_flight),
+      m_output(transport.output_length()) {
+}
+
+ReportPump::~ReportPump() {
+    stop();
+}
+
+void ReportPump::start() {
+    if (m_thread.joinable()) {
+        return;
+    }
+    m_stop.store(false, std::memory_order_relaxed);
+    m_thread = std::thread([this] {
+        while (!m_stop.load(std::memory_order_relaxed)) {
+            pump(std::chrono::milliseconds(100));
+        }
+    });
+}
+
+void ReportPump::stop() {
+    m_stop.store(true, std::memory_order_relaxed);
+    m_transport.cancel_reads();
+    m_space.notify();
+    if (m_thread.joinable()) {
+        m_thread.join();
+    }
+
+    // the thread may have queued another read after the cancel; either way
+    // the transport must be done with the ring before it can go away
+    m_transport.cancel_reads();
+    while (m_submitted != m_completed.load(std::memory_order_relaxed)) {
+        auto completed = m_completed.load(std::memory_order_relaxed);
+        auto taken = m_transport.wait_reads(m_transferred.data(), m_in_flight, std::chrono::milliseconds(100));
+        for (size_t i = 0; i < taken; ++i) {
+            m_lengths[(completed + i) % m_chunks] = m_transferred[i];
+        }
+        m_completed.store(completed + taken, std::memory_order_release);
+    }
+    m_ready.notify();
+}
+
+bool ReportPump::pump(std::chrono::milliseconds timeout) {
+    auto completed = m_completed.load(std::memory_order_relaxed);
+
+    while (m_submitted - completed < m_in_flight && !m_stop.load(std::memory_order_relaxed)) {
+        if (m_submitted - m_consumed.load(std::memory_order_acquire) == m_chunks) {
+            m_stalls.fetch_add(1, std::memory_order_relaxed);
+            break;
+        }
+        if (!m_transport.read_async(chunk(m_submitted), m_chunk_bytes)) {
+            break;
+        }
+        ++m_submitted;
+    }
+
+    if (m_submitted == completed) {
+        // nothing in flight: the ring is full, or the device refused the read
+        auto deadline = spsc_detail::clock::now() + timeout;
+        auto full = m_submitted - m_consumed.load(std::memory_order_acquire) == m_chunks;
+        m_space.wait(
+            [&] {
+                return m_stop.load(std::memory_order_relaxed) ||
+                       (full && m_submitted - m_consumed.load(std::memory_order_acquire) < m_chunks);
+            },
+            deadline);
+        return false;
+    }
+
+    auto taken = m_transport.wait_reads(m_transferred.data(), m_submitted - completed, timeout);
+    if (taken == 0) {
+        return false;
+    }
+
+    size_t reports = 0, failed = 0;
+    for (size_t i = 0; i < taken; ++i) {
+        m_lengths[(completed + i) % m_chunks] = m_transferred[i];
+        reports += m_transferred[i] / m_transport.input_length();
+        failed += m_transferred[i] == 0;
+    }
+    m_reports.fetch_add(reports, std::memory_order_relaxed);
+    m_failed.fetch_add(failed, std::memory_order_relaxed);
+
+    m_completed.store(completed + taken, std::memory_order_release);
+    m_ready.notify();
+    return true;
+}
+
+bool ReportPump::poll(ReportBatch &batch, std::chrono::milliseconds timeout) {
+    auto deadline = spsc_detail::clock::now() + timeout;
+    auto consumed = m_consumed.load(std::memory_order_relaxed);
+
+    for (;;) {
+        if (!m_ready.wait([&] { return m_completed.load(std::memory_order_acquire) != consumed; }, deadline)) {
+            return false;
+        }
+
+        // failed and cancelled reads carry no reports, their buffers go straight back
+        auto length = m_lengths[consumed % m_chunks];
+        if (length < m_transport.input_length()) {
+            m_consumed.store(++consumed, std::memory_order_release);
+            m_space.notify();
+            continue;
+        }
+
+        batch.data = chunk(consumed);
+        batch.stride = m_transport.input_length();
+        batch.count = length / batch.stride;
+        batch.chunk = consumed;
+        return true;
+    }
+}
+
+void ReportPump::release(const ReportBatch &batch) {
+    m_consumed.store(batch.chunk + 1, std::memory_order_release);
+    m_space.notify();
+}
+
+bool ReportPump::write(uint8_t report_id, const uint8_t *data, size_t length) {
+    if (m_output.empty() || length != m_output.size() - 1) {
+        return false;
+    }
+    m_output[0] = report_id;
+    std::memcpy(&m_output[1], data, length);
+    return m_transport.write(m_output.data(), m_output.size());
+}
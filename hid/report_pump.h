@@ -0,0 +1,102 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <stddef.h>
+#include <stdint.h>
+#include <thread>
+#include <vector>
+
+#include "transport.h"
+#include "../spsc_queue/wait_policy.hpp"
+
+// A batch of input reports, straight from the pump's ring.
+struct ReportBatch {
+    const uint8_t *data = nullptr;
+    size_t count = 0;  // reports
+    size_t stride = 0; // bytes per report
+    uint64_t chunk = 0;
+
+    const uint8_t *report(size_t index) const { return data + index * stride; }
+};
+
+// Keeps `reads_in_flight` reads queued on a transport so the device never
+// waits for us, and hands the reports to one consumer in batches. Reads land
+// directly in a preallocated ring of `chunks` buffers of `reports_per_read`
+// reports each; a buffer goes back to the device only after the consumer
+// released it, so nothing is copied or allocated per report. When the
+// consumer falls behind the ring fills up, reads stop being queued and the
+// device side buffers (and eventually drops) reports instead.
+//
+//   ReportPump pump(transport);
+//   pump.start();
+//   ReportBatch batch;
+//   while (pump.poll(batch, std::chrono::milliseconds(100))) {
+//       for (size_t i = 0; i < batch.count; ++i) ...batch.report(i)...
+//       pump.release(batch);
+//   }
+//
+// poll and release must be called from one consumer thread, write from one
+// writer thread, which may be the consumer and runs alongside the pump's
+// reads (see Transport). Instead of start(), pump() may be called by hand.
+class ReportPump {
+public:
+    explicit ReportPump(Transport &transport, size_t reads_in_flight = 4, size_t reports_per_read = 8, size_t chunks = 32);
+    ~ReportPump();
+
+    ReportPump(const ReportPump &) = delete;
+    ReportPump &operator=(const ReportPump &) = delete;
+
+    // run pump() on a thread until stop()
+    void start();
+
+    // cancel the reads, wait for them and the thread
+    void stop();
+
+    // queue reads into free buffers, then wait up to `timeout` for them and
+    // publish what completed; false if nothing did
+    bool pump(std::chrono::milliseconds timeout);
+
+    // wait for the next batch, false on timeout
+    bool poll(ReportBatch &batch, std::chrono::milliseconds timeout);
+
+    // hand the batch's buffer back for reading, batches are released in order
+    void release(const ReportBatch &batch);
+
+    // send one output report; `length` is the report without its id, like HID::write
+    bool write(uint8_t report_id, const uint8_t *data, size_t length);
+
+    uint64_t reports() const { return m_reports.load(std::memory_order_relaxed); }
+    uint64_t failed_reads() const { return m_failed.load(std::memory_order_relaxed); }
+
+    // times a read could not be queued because every buffer was waiting for the consumer
+    uint64_t stalls() const { return m_stalls.load(std::memory_order_relaxed); }
+
+private:
+    uint8_t *chunk(uint64_t index) { return &m_ring[(index % m_chunks) * m_chunk_bytes]; }
+
+    Transport &m_transport;
+    size_t m_in_flight;
+    size_t m_chunks;
+    size_t m_chunk_bytes;
+
+    std::vector<uint8_t> m_ring;
+    std::vector<size_t> m_lengths;     // bytes the read of each chunk returned
+    std::vector<size_t> m_transferred; // wait_reads scratch
+    std::vector<uint8_t> m_output;
+
+    // chunk counters, they only grow: submitted >= completed >= consumed
+    uint64_t m_submitted = 0; // pump side only
+    std::atomic<uint64_t> m_completed{0};
+    std::atomic<uint64_t> m_consumed{0};
+
+    ParkWait<> m_ready; // consumer waits for completed chunks
+    ParkWait<> m_space; // pump waits for released chunks
+
+    std::atomic<bool> m_stop{false};
+    std::thread m_thread;
+
+    std::atomic<uint64_t> m_reports{0};
+    std::atomic<uint64_t> m_failed{0};
+    std::atomic<uint64_t> m_stalls{0};
+};
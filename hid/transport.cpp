@@ -0,0 +1,207 @@
+#include "transport.h"
+
+#include <algorithm>
+#include <cstring>
+
+LoopbackTransport::LoopbackTransport(size_t report_length, size_t queue_reports, size_t max_reads)
+    : m_report_length(std::max<size_t>(report_length, 1)),
+      m_queue(m_report_length * std::max<size_t>(queue_reports, 1)),
+      m_reads(std::max<size_t>(max_reads, 1)) {
+}
+
+void LoopbackTransport::satisfy() {
+    auto queue_reports = m_queue.size() / m_report_length;
+
+    // reads complete in order, so only the first one not done yet takes reports
+    for (size_t i = 0; i < m_read_count && m_queue_count > 0; ++i) {
+        auto &read = m_reads[(m_read_head + i) % m_reads.size()];
+        if (read.done) {
+            continue;
+        }
+        while (m_queue_count > 0 && read.length - read.transferred >= m_report_length) {
+            std::memcpy(read.buffer + read.transferred, &m_queue[m_queue_head * m_report_length], m_report_length);
+            read.transferred += m_report_length;
+            m_queue_head = (m_queue_head + 1) % queue_reports;
+            --m_queue_count;
+        }
+        read.done = true;
+    }
+}
+
+bool LoopbackTransport::read_async(uint8_t *buffer, size_t length) {
+    if (length < m_report_length) {
+        return false;
+    }
+    std::lock_guard<std::mutex> lock(m_lock);
+    if (m_read_count == m_reads.size()) {
+        return false;
+    }
+    m_reads[(m_read_head + m_read_count) % m_reads.size()] = Read{buffer, length, 0, false};
+    ++m_read_count;
+    satisfy();
+    return true;
+}
+
+size_t LoopbackTransport::wait_reads(size_t *transferred, size_t max, std::chrono::milliseconds timeout) {
+    std::unique_lock<std::mutex> lock(m_lock);
+    if (m_read_count == 0) {
+        return 0;
+    }
+
+    auto ready = [&] { return m_reads[m_read_head].done; };
+    if (!ready()) {
+        m_waiting = true;
+        m_completed.wait_for(lock, timeout, ready);
+        m_waiting = false;
+    }
+
+    size_t taken = 0;
+    while (taken < max && m_read_count > 0 && m_reads[m_read_head].done) {
+        transferred[taken++] = m_reads[m_read_head].transferred;
+        m_read_head = (m_read_head + 1) % m_reads.size();
+        --m_read_count;
+    }
+    return taken;
+}
+
+void LoopbackTransport::cancel_reads() {
+    {
+        std::lock_guard<std::mutex> lock(m_lock);
+        for (size_t i = 0; i < m_read_count; ++i) {
+            m_reads[(m_read_head + i) % m_reads.size()].done = true;
+        }
+    }
+    m_completed.notify_all();
+}
+
+bool LoopbackTransport::inject(const uint8_t *report, size_t length) {
+    if (length != m_report_length) {
+        return false;
+    }
+
+    bool wake;
+    {
+        std::lock_guard<std::mutex> lock(m_lock);
+        auto queue_reports = m_queue.size() / m_report_length;
+        if (m_queue_count == queue_reports) {
+            m_queue_head = (m_queue_head + 1) % queue_reports;
+            --m_queue_count;
+            ++m_dropped;
+        }
+        std::memcpy(&m_queue[(m_queue_head + m_queue_count) % queue_reports * m_report_length], report, length);
+        ++m_queue_count;
+        satisfy();
+        // only a sleeping reader costs a wake up
+        wake = m_waiting;
+    }
+    if (wake) {
+        m_completed.notify_one();
+    }
+    return true;
+}
+
+uint64_t LoopbackTransport::dropped() const {
+    std::lock_guard<std::mutex> lock(m_lock);
+    return m_dropped;
+}
+
+#ifdef _WIN32
+
+Win32Transport::Win32Transport(const Device &device, size_t max_reads, ULONG input_buffers)
+    : m_input_length(device.caps.InputReportByteLength),
+      m_output_length(device.caps.OutputReportByteLength),
+      m_reads(std::max<size_t>(max_reads, 1)) {
+    // enum_device opens the device for blocking I/O
+    m_handle = ReOpenFile(device.device_handle, GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ | FILE_SHARE_WRITE, FILE_FLAG_OVERLAPPED);
+    if (m_handle != INVALID_HANDLE_VALUE) {
+        HidD_SetNumInputBuffers(m_handle, input_buffers);
+    }
+
+    for (auto &read : m_reads) {
+        read = Read{};
+        read.overlapped.hEvent = CreateEvent(NULL, true, false, NULL);
+    }
+    m_write = OVERLAPPED{};
+    m_write.hEvent = CreateEvent(NULL, true, false, NULL);
+}
+
+Win32Transport::~Win32Transport() {
+    if (m_handle != INVALID_HANDLE_VALUE) {
+        // the driver must be done with the buffers before they go away
+        CancelIoEx(m_handle, NULL);
+        for (size_t i = 0; i < m_read_count; ++i) {
+            auto &read = m_reads[(m_read_head + i) % m_reads.size()];
+            DWORD count;
+            if (!read.failed) {
+                GetOverlappedResult(m_handle, &read.overlapped, &count, true);
+            }
+        }
+        CloseHandle(m_handle);
+    }
+
+    for (auto &read : m_reads) {
+        CloseHandle(read.overlapped.hEvent);
+    }
+    CloseHandle(m_write.hEvent);
+}
+
+bool Win32Transport::read_async(uint8_t *buffer, size_t length) {
+    if (m_handle == INVALID_HANDLE_VALUE || m_read_count == m_reads.size() || length < m_input_length) {
+        return false;
+    }
+
+    auto &read = m_reads[(m_read_head + m_read_count) % m_reads.size()];
+    auto event = read.overlapped.hEvent;
+    read.overlapped = OVERLAPPED{};
+    read.overlapped.hEvent = event;
+
+    // ReadFile resets the event itself
+    read.failed = !ReadFile(m_handle, buffer, DWORD(length), NULL, &read.overlapped) && GetLastError() != ERROR_IO_PENDING;
+    ++m_read_count;
+    return true;
+}
+
+size_t Win32Transport::wait_reads(size_t *transferred, size_t max, std::chrono::milliseconds timeout) {
+    if (m_read_count == 0) {
+        return 0;
+    }
+
+    auto &oldest = m_reads[m_read_head];
+    if (!completed(oldest) && WaitForSingleObject(oldest.overlapped.hEvent, DWORD(timeout.count())) != WAIT_OBJECT_0) {
+        return 0;
+    }
+
+    // whatever finished behind the oldest is taken without another wait
+    size_t taken = 0;
+    while (taken < max && m_read_count > 0 && completed(m_reads[m_read_head])) {
+        auto &read = m_reads[m_read_head];
+        DWORD count = 0;
+        if (read.failed || !GetOverlappedResult(m_handle, &read.overlapped, &count, false)) {
+            count = 0;
+        }
+        transferred[taken++] = count;
+        m_read_head = (m_read_head + 1) % m_reads.size();
+        --m_read_count;
+    }
+    return taken;
+}
+
+void Win32Transport::cancel_reads() {
+    if (m_handle != INVALID_HANDLE_VALUE) {
+        CancelIoEx(m_handle, NULL);
+    }
+}
+
+bool Win32Transport::write(const uint8_t *report, size_t length) {
+    if (m_handle == INVALID_HANDLE_VALUE || length != m_output_length) {
+        return false;
+    }
+
+    DWORD count = 0;
+    if (!WriteFile(m_handle, report, DWORD(length), NULL, &m_write) && GetLastError() != ERROR_IO_PENDING) {
+        return false;
+    }
+    return GetOverlappedResult(m_handle, &m_write, &count, true) && count == length;
+}
+
+#endif
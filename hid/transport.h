@@ -0,0 +1,139 @@
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+// Where HID reports come from and go to. Reads are asynchronous: up to
+// max_reads() buffers can be queued, and they complete in the order they
+// were queued. A read may return several reports at once when the device
+// side had more than one buffered, so its length is a multiple of
+// input_length().
+//
+// read_async and wait_reads are called from one thread (the pump). write is
+// called from one thread too, which may be another one and may run while the
+// pump waits for reads, so writes must not share state with reads.
+// cancel_reads may be called from any thread.
+class Transport {
+public:
+    virtual ~Transport() = default;
+
+    // bytes of one input / output report, the report id byte included
+    virtual size_t input_length() const = 0;
+    virtual size_t output_length() const = 0;
+
+    virtual size_t max_reads() const = 0;
+
+    // queue a read into `buffer`, false if max_reads() are already queued or the device is gone
+    virtual bool read_async(uint8_t *buffer, size_t length) = 0;
+
+    // wait up to `timeout` for the oldest read, then take it and every read
+    // after it that has completed too, at most `max`; `transferred` gets the
+    // bytes of each, 0 for a failed or cancelled read. Returns how many were taken.
+    virtual size_t wait_reads(size_t *transferred, size_t max, std::chrono::milliseconds timeout) = 0;
+
+    // make every queued read complete soon, they still have to be taken with wait_reads
+    virtual void cancel_reads() = 0;
+
+    virtual bool write(const uint8_t *report, size_t length) = 0;
+};
+
+// A device in memory: reports given to inject() (or written to it) are
+// handed to queued reads, or kept in a fixed queue of `queue_reports` until
+// one is queued, the oldest dropped when it is full, like the HID driver
+// does. Nothing is allocated after construction.
+class LoopbackTransport : public Transport {
+public:
+    explicit LoopbackTransport(size_t report_length, size_t queue_reports = 64, size_t max_reads = 16);
+
+    size_t input_length() const override { return m_report_length; }
+    size_t output_length() const override { return m_report_length; }
+    size_t max_reads() const override { return m_reads.size(); }
+
+    bool read_async(uint8_t *buffer, size_t length) override;
+    size_t wait_reads(size_t *transferred, size_t max, std::chrono::milliseconds timeout) override;
+    void cancel_reads() override;
+
+    // written reports come back as input
+    bool write(const uint8_t *report, size_t length) override { return inject(report, length); }
+
+    // the device sends a report, from any thread
+    bool inject(const uint8_t *report, size_t length);
+
+    uint64_t dropped() const;
+
+private:
+    struct Read {
+        uint8_t *buffer;
+        size_t length;
+        size_t transferred;
+        bool done;
+    };
+
+    // hand queued reports to the oldest reads still waiting, lock held
+    void satisfy();
+
+    size_t m_report_length;
+
+    mutable std::mutex m_lock;
+    std::condition_variable m_completed;
+    bool m_waiting = false;
+
+    std::vector<uint8_t> m_queue; // queue_reports reports, a ring
+    size_t m_queue_head = 0;
+    size_t m_queue_count = 0;
+    uint64_t m_dropped = 0;
+
+    std::vector<Read> m_reads; // a ring, in the order they were queued
+    size_t m_read_head = 0;
+    size_t m_read_count = 0;
+};
+
+#ifdef _WIN32
+#include "hid.h"
+
+// Overlapped reads on a device from HID::enum_device. The handle is reopened
+// for overlapped I/O and every read slot keeps its event, so reading does not
+// create or close anything.
+class Win32Transport : public Transport {
+public:
+    // `input_buffers` is how many reports the driver keeps while no read is queued
+    explicit Win32Transport(const Device &device, size_t max_reads = 16, ULONG input_buffers = 64);
+    ~Win32Transport();
+
+    Win32Transport(const Win32Transport &) = delete;
+    Win32Transport &operator=(const Win32Transport &) = delete;
+
+    bool valid() const { return m_handle != INVALID_HANDLE_VALUE; }
+
+    size_t input_length() const override { return m_input_length; }
+    size_t output_length() const override { return m_output_length; }
+    size_t max_reads() const override { return m_reads.size(); }
+
+    bool read_async(uint8_t *buffer, size_t length) override;
+    size_t wait_reads(size_t *transferred, size_t max, std::chrono::milliseconds timeout) override;
+    void cancel_reads() override;
+    bool write(const uint8_t *report, size_t length) override;
+
+private:
+    struct Read {
+        OVERLAPPED overlapped;
+        bool failed;
+    };
+
+    bool completed(const Read &read) const { return read.failed || HasOverlappedIoCompleted(&read.overlapped); }
+
+    HANDLE m_handle;
+    size_t m_input_length;
+    size_t m_output_length;
+
+    std::vector<Read> m_reads;
+    size_t m_read_head = 0;
+    size_t m_read_count = 0;
+
+    OVERLAPPED m_write;
+};
+#endif
@@ -0,0 +1,314 @@
+// Latency / throughput benchmark for SpscQueue.
+//
+//   benchmark [producer_cpu] [consumer_cpu] [round_trips] [stream_items]
+//
+// Pick the two cpus to compare placements: the same core, two SMT siblings
+// (see /sys/devices/system/cpu/cpu0/topology/thread_siblings_list) or cores
+// on different sockets. Negative cpu ids leave the thread unpinned. When the
+// threads may share a core (the same cpu, a cpu that cannot be pinned, or a
+// single cpu machine) both sides yield instead of spinning, or every wait
+// would last a whole time slice; those numbers measure the scheduler, not
+// the queue.
+//
+// latency:    ping-pong over two queues, one sample per round trip in tsc ticks
+// throughput: producer streams items one way as fast as the consumer drains
+
+#include "spsc_queue.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <stdint.h>
+#include <thread>
+#include <vector>
+
+#if defined(_WIN32)
+#define WIN32_LEAN_AND_MEAN
+#include <Windows.h>
+#include <intrin.h>
+#else
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+namespace
+{
+    uint64_t ticks()
+    {
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+        return __rdtsc();
+#else
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(
+                   std::chrono::steady_clock::now().time_since_epoch())
+            .count();
+#endif
+    }
+
+    // tsc ticks per nanosecond, measured against steady_clock
+    double calibrate()
+    {
+        auto const _t0 = std::chrono::steady_clock::now();
+        auto const _c0 = ticks();
+        std::this_thread::sleep_for(std::chrono::milliseconds(200));
+        auto const _c1 = ticks();
+        auto const _t1 = std::chrono::steady_clock::now();
+        auto _ns = std::chrono::duration_cast<std::chrono::nanoseconds>(_t1 - _t0).count();
+        return double(_c1 - _c0) / double(_ns);
+    }
+
+    // false when the thread could not be pinned, a negative cpu asks for no pinning
+    bool pin(int cpu)
+    {
+        if (cpu < 0)
+            return true;
+#if defined(_WIN32)
+        if (cpu >= int(sizeof(DWORD_PTR) * 8))
+            return false;
+        return SetThreadAffinityMask(GetCurrentThread(), DWORD_PTR(1) << cpu) != 0;
+#else
+        if (cpu >= CPU_SETSIZE)
+            return false;
+        cpu_set_t _set;
+        CPU_ZERO(&_set);
+        CPU_SET(cpu, &_set);
+        return pthread_setaffinity_np(pthread_self(), sizeof(_set), &_set) == 0;
+#endif
+    }
+
+    // HDR style log-linear histogram: every power of two is split into
+    // 2^sub_bits equal buckets, so relative error stays below 2^-sub_bits
+    class Histogram
+    {
+    public:
+        static constexpr int sub_bits = 5;
+        static constexpr int sub_count = 1 << sub_bits;
+
+        Histogram() : m_counts(64 * sub_count, 0) {}
+
+        void record(uint64_t value)
+        {
+            m_counts[index(value)]++;
+            m_total++;
+            m_max = std::max(m_max, value);
+        }
+
+        // smallest value with at least `q` of all samples at or below it
+        uint64_t percentile(double q) const
+        {
+            auto _rank = static_cast<uint64_t>(std::ceil(q * double(m_total)));
+            uint64_t _seen = 0;
+            for (size_t i = 0; i < m_counts.size(); ++i)
+            {
+                _seen += m_counts[i];
+                if (_seen >= _rank && m_counts[i])
+                    return std::min(upper(i), m_max);
+            }
+            return m_max;
+        }
+
+        uint64_t max() const { return m_max; }
+
+    private:
+        static size_t index(uint64_t value)
+        {
+            if (value < sub_count)
+                return static_cast<size_t>(value);
+            int _log = 63 - count_leading_zeros(value);
+            int _shift = _log - sub_bits;
+            auto _sub = (value >> _shift) & (sub_count - 1);
+            return static_cast<size_t>((_shift + 1) * sub_count + _sub);
+        }
+
+        static uint64_t upper(size_t index)
+        {
+            if (index < sub_count)
+                return index;
+            auto _shift = index / sub_count - 1;
+            auto _sub = index % sub_count;
+            return ((uint64_t(sub_count + _sub) + 1) << _shift) - 1;
+        }
+
+        static int count_leading_zeros(uint64_t value)
+        {
+#if defined(_MSC_VER)
+            unsigned long _index;
+            _BitScanReverse64(&_index, value);
+            return 63 - int(_index);
+#else
+            return __builtin_clzll(value);
+#endif
+        }
+
+        std::vector<uint64_t> m_counts;
+        uint64_t m_total = 0;
+        uint64_t m_max = 0;
+    };
+
+    template <size_t bytes>
+    struct Payload
+    {
+        uint64_t stamp;
+        uint8_t data[bytes - sizeof(uint64_t)];
+    };
+
+    struct Options
+    {
+        int producer_cpu = 0;
+        int consumer_cpu = 1;
+        uint64_t round_trips = 200000;
+        uint64_t stream_items = 5000000;
+        double ticks_per_ns = 1.0;
+        bool yield = false; // the threads may share a core, see main
+
+        bool same_core() const { return producer_cpu >= 0 && producer_cpu == consumer_cpu; }
+    };
+
+    // spin while the other side runs on another core, hand the core over when it shares ours
+    template <typename Queue, typename Item>
+    void pop(Queue &queue, Item &item, bool yield)
+    {
+        while (!queue.try_pop(item))
+        {
+            if (yield)
+                std::this_thread::yield();
+        }
+    }
+
+    template <typename Queue, typename Item>
+    void push(Queue &queue, const Item &item, bool yield)
+    {
+        while (!queue.try_push(item))
+        {
+            if (yield)
+                std::this_thread::yield();
+        }
+    }
+
+    template <size_t bytes, size_t capacity>
+    void run(const Options &options)
+    {
+        using Item = Payload<bytes>;
+        using Queue = SpscQueue<Item, capacity>;
+
+        // ping-pong latency
+        auto _ping = std::make_unique<Queue>();
+        auto _pong = std::make_unique<Queue>();
+        Histogram _histogram;
+        auto const _yield = options.yield;
+
+        std::thread _echo([&]
+                          {
+            pin(options.consumer_cpu);
+            Item _item;
+            for (uint64_t i = 0; i < options.round_trips; ++i)
+            {
+                pop(*_ping, _item, _yield);
+                push(*_pong, _item, _yield);
+            } });
+
+        pin(options.producer_cpu);
+        Item _item{};
+        for (uint64_t i = 0; i < options.round_trips; ++i)
+        {
+            _item.stamp = ticks();
+            push(*_ping, _item, _yield);
+            pop(*_pong, _item, _yield);
+            _histogram.record(ticks() - _item.stamp);
+        }
+        _echo.join();
+
+        // one way streaming throughput
+        auto _stream = std::make_unique<Queue>();
+        std::thread _consumer([&]
+                              {
+            pin(options.consumer_cpu);
+            Item _value;
+            for (uint64_t i = 0; i < options.stream_items; ++i)
+            {
+                pop(*_stream, _value, _yield);
+            } });
+
+        auto const _begin = std::chrono::steady_clock::now();
+        for (uint64_t i = 0; i < options.stream_items; ++i)
+        {
+            _item.stamp = i;
+            push(*_stream, _item, _yield);
+        }
+        _consumer.join();
+        auto const _seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - _begin).count();
+
+        auto _ns = [&](uint64_t t)
+        { return double(t) / options.ticks_per_ns; };
+        auto _rate = double(options.stream_items) / _seconds;
+
+        std::printf("%6zu %8zu %10.0f %10.0f %10.0f %10.0f %12.2f %10.1f\n",
+                    bytes, capacity,
+                    _ns(_histogram.percentile(0.50)),
+                    _ns(_histogram.percentile(0.99)),
+                    _ns(_histogram.percentile(0.999)),
+                    _ns(_histogram.max()),
+                    _rate / 1e6,
+                    _rate * bytes / (1024.0 * 1024.0));
+    }
+
+    template <size_t bytes>
+    void sweep_capacity(const Options &options)
+    {
+        run<bytes, 64>(options);
+        run<bytes, 1024>(options);
+        run<bytes, 16384>(options);
+    }
+}
+
+int main(int argc, char **argv)
+{
+    Options _options;
+    if (argc > 1)
+        _options.producer_cpu = std::atoi(argv[1]);
+    if (argc > 2)
+        _options.consumer_cpu = std::atoi(argv[2]);
+    if (argc > 3)
+        _options.round_trips = std::strtoull(argv[3], nullptr, 10);
+    if (argc > 4)
+        _options.stream_items = std::strtoull(argv[4], nullptr, 10);
+
+    // the placement we actually get decides whether spinning is safe, try it
+    // on this thread (the producer) and on a throwaway one (the consumer)
+    auto _producer_pinned = pin(_options.producer_cpu);
+    auto _consumer_pinned = false;
+    std::thread([&]
+                { _consumer_pinned = pin(_options.consumer_cpu); })
+        .join();
+    if (!_producer_pinned)
+        std::fprintf(stderr, "warning: cannot pin to cpu %d, running unpinned\n", _options.producer_cpu);
+    if (!_consumer_pinned)
+        std::fprintf(stderr, "warning: cannot pin to cpu %d, running unpinned\n", _options.consumer_cpu);
+    auto const _single_cpu = std::thread::hardware_concurrency() < 2;
+    _options.yield = _options.same_core() || !_producer_pinned || !_consumer_pinned || _single_cpu;
+
+    _options.ticks_per_ns = calibrate();
+
+    std::printf("producer cpu %d, consumer cpu %d, %.3f ticks/ns\n",
+                _options.producer_cpu, _options.consumer_cpu, _options.ticks_per_ns);
+    if (_options.yield)
+        std::printf("warning: the threads may share a cpu (%s), they yield to each other and the numbers measure the scheduler\n",
+                    _options.same_core() ? "same cpu requested" : _single_cpu ? "single cpu machine" : "pinning failed");
+    std::printf("round trip latency in ns, throughput one way\n");
+    std::printf("%6s %8s %10s %10s %10s %10s %12s %10s\n",
+                "bytes", "slots", "p50", "p99", "p99.9", "max", "Mitems/s", "MiB/s");
+
+    sweep_capacity<16>(_options);
+    sweep_capacity<64>(_options);
+    sweep_capacity<256>(_options);
+    sweep_capacity<1024>(_options);
+
+    return 0;
+}
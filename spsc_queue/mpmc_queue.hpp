@@ -0,0 +1,241 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <new>
+#include <stdint.h>
+#include <type_traits>
+#include <utility>
+
+#include "wait_policy.hpp"
+
+// Bounded multi producer / multi consumer queue (Dmitry Vyukov's design).
+// Every slot carries a sequence number that tells whose turn it is:
+//   seq == pos          slot is free for the producer that claimed `pos`
+//   seq == pos + 1      slot holds the value for the consumer that claimed `pos`
+// Producers and consumers claim positions with a CAS on their own index and
+// never touch the other side's index.
+template <typename T, size_t size = 1024, typename Wait = SpinWait>
+class MpmcQueue
+{
+    static_assert(size >= 2 && (size & (size - 1)) == 0, "size must be a power of two");
+    static_assert(std::is_nothrow_destructible<T>::value, "T must be nothrow destructible");
+
+public:
+    MpmcQueue()
+        : m_slot(new _T[size])
+    {
+        for (size_t i = 0; i < size; ++i)
+        {
+            m_slot[i].seq.store(i, std::memory_order_relaxed);
+        }
+    }
+
+    ~MpmcQueue()
+    {
+        auto const _tail = m_tail.load(std::memory_order_relaxed);
+        for (auto _pos = m_head.load(std::memory_order_relaxed); _pos != _tail; ++_pos)
+        {
+            m_slot[_pos & __mask].get()->~T();
+        }
+    }
+
+    MpmcQueue(const MpmcQueue &_) = delete;
+    MpmcQueue &operator=(const MpmcQueue &_) = delete;
+
+    // only a snapshot when other threads are running
+    bool empty()
+    {
+        auto const _head = m_head.load(std::memory_order_acquire);
+        return m_slot[_head & __mask].seq.load(std::memory_order_acquire) != _head + 1;
+    }
+
+    // construct value in place, wait while queue is full
+    template <typename... Args>
+    void emplace(Args &&...args)
+    {
+        emplace_until<true>(spsc_detail::forever, std::forward<Args>(args)...);
+    }
+
+    void push(const T &val)
+    {
+        emplace(val);
+    }
+
+    void push(T &&val)
+    {
+        emplace(std::move(val));
+    }
+
+    // construct value in place only if there is room, never waits
+    template <typename... Args>
+    bool try_emplace(Args &&...args)
+    {
+        return emplace_until<false>(spsc_detail::forever, std::forward<Args>(args)...);
+    }
+
+    bool try_push(const T &val)
+    {
+        return try_emplace(val);
+    }
+
+    bool try_push(T &&val)
+    {
+        return try_emplace(std::move(val));
+    }
+
+    // wait at most `timeout` for room, return false if the queue stayed full
+    template <typename Rep, typename Period>
+    bool push_for(const T &val, const std::chrono::duration<Rep, Period> &timeout)
+    {
+        return emplace_until<true>(spsc_detail::clock::now() + timeout, val);
+    }
+
+    template <typename Rep, typename Period>
+    bool push_for(T &&val, const std::chrono::duration<Rep, Period> &timeout)
+    {
+        return emplace_until<true>(spsc_detail::clock::now() + timeout, std::move(val));
+    }
+
+    // move the oldest value into `val`, return false if queue is empty
+    bool try_pop(T &val)
+    {
+        return pop_until<false>(val, spsc_detail::forever);
+    }
+
+    // wait until a value arrives, then move it into `val`
+    void pop_wait(T &val)
+    {
+        pop_until<true>(val, spsc_detail::forever);
+    }
+
+    // wait at most `timeout` for a value, return false if the queue stayed empty
+    template <typename Rep, typename Period>
+    bool pop_for(T &val, const std::chrono::duration<Rep, Period> &timeout)
+    {
+        return pop_until<true>(val, spsc_detail::clock::now() + timeout);
+    }
+
+private:
+    template <bool wait, typename... Args>
+    bool emplace_until(spsc_detail::clock::time_point deadline, Args &&...args)
+    {
+        // a claimed slot must always be published, or consumers would stall on it,
+        // so a constructor that may throw runs before the claim
+        if constexpr (!std::is_nothrow_constructible<T, Args &&...>::value)
+        {
+            static_assert(std::is_nothrow_move_constructible<T>::value, "T must be nothrow move constructible");
+            return claim<wait>(deadline, T(std::forward<Args>(args)...));
+        }
+        else
+        {
+            return claim<wait>(deadline, std::forward<Args>(args)...);
+        }
+    }
+
+    template <bool wait, typename... Args>
+    bool claim(spsc_detail::clock::time_point deadline, Args &&...args)
+    {
+        auto _pos = m_tail.load(std::memory_order_relaxed);
+        _T *_slot;
+        for (;;)
+        {
+            _slot = &m_slot[_pos & __mask];
+            auto const _seq = _slot->seq.load(std::memory_order_acquire);
+            auto const _diff = static_cast<intptr_t>(_seq) - static_cast<intptr_t>(_pos);
+            if (_diff == 0)
+            {
+                if (m_tail.compare_exchange_weak(_pos, _pos + 1, std::memory_order_relaxed))
+                    break;
+            }
+            else if (_diff < 0)
+            {
+                // the slot still holds the value from one lap ago: full
+                auto _ready = [&]
+                { return _slot->seq.load(std::memory_order_acquire) != _seq; };
+                if (!wait || !m_not_full.wait(_ready, deadline))
+                    return false;
+                _pos = m_tail.load(std::memory_order_relaxed);
+            }
+            else
+            {
+                _pos = m_tail.load(std::memory_order_relaxed);
+            }
+        }
+
+        new (_slot->storage) T(std::forward<Args>(args)...);
+        _slot->seq.store(_pos + 1, std::memory_order_release);
+        m_not_empty.notify();
+        return true;
+    }
+
+    template <bool wait>
+    bool pop_until(T &val, spsc_detail::clock::time_point deadline)
+    {
+        static_assert(std::is_nothrow_move_assignable<T>::value, "T must be nothrow move assignable");
+
+        auto _pos = m_head.load(std::memory_order_relaxed);
+        _T *_slot;
+        for (;;)
+        {
+            _slot = &m_slot[_pos & __mask];
+            auto const _seq = _slot->seq.load(std::memory_order_acquire);
+            auto const _diff = static_cast<intptr_t>(_seq) - static_cast<intptr_t>(_pos + 1);
+            if (_diff == 0)
+            {
+                if (m_head.compare_exchange_weak(_pos, _pos + 1, std::memory_order_relaxed))
+                    break;
+            }
+            else if (_diff < 0)
+            {
+                // nothing published at this position yet: empty
+                auto _ready = [&]
+                { return _slot->seq.load(std::memory_order_acquire) != _seq; };
+                if (!wait || !m_not_empty.wait(_ready, deadline))
+                    return false;
+                _pos = m_head.load(std::memory_order_relaxed);
+            }
+            else
+            {
+                _pos = m_head.load(std::memory_order_relaxed);
+            }
+        }
+
+        auto _value = _slot->get();
+        val = std::move(*_value);
+        _value->~T();
+        _slot->seq.store(_pos + size, std::memory_order_release);
+        m_not_full.notify();
+        return true;
+    }
+
+#ifdef __cpp_lib_hardware_interference_size
+    static constexpr size_t __chache_line_size =
+        std::hardware_destructive_interference_size;
+#else
+    static constexpr size_t __chache_line_size = 64;
+#endif
+
+    static constexpr size_t __mask = size - 1;
+
+    struct alignas(__chache_line_size) _T
+    {
+        std::atomic<size_t> seq;
+        alignas(T) unsigned char storage[sizeof(T)];
+
+        T *get()
+        {
+            return std::launder(reinterpret_cast<T *>(storage));
+        }
+    };
+
+    alignas(__chache_line_size) std::unique_ptr<_T[]> m_slot;
+    alignas(__chache_line_size) std::atomic<size_t> m_head{0};
+    alignas(__chache_line_size) std::atomic<size_t> m_tail{0};
+
+    // producers wait on m_not_full, consumers wait on m_not_empty
+    alignas(__chache_line_size) Wait m_not_full;
+    alignas(__chache_line_size) Wait m_not_empty;
+};
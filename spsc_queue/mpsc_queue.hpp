@@ -0,0 +1,248 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <new>
+#include <stdint.h>
+#include <type_traits>
+#include <utility>
+
+#include "wait_policy.hpp"
+
+// Bounded multi producer / single consumer queue.
+// Producers claim slots like MpmcQueue, with a CAS on the tail and a per-slot
+// sequence number. The single consumer owns the head, so it needs no CAS and
+// can peek at the head value in place like SpscQueue.
+template <typename T, size_t size = 1024, typename Wait = SpinWait>
+class MpscQueue
+{
+    static_assert(size >= 2 && (size & (size - 1)) == 0, "size must be a power of two");
+    static_assert(std::is_nothrow_destructible<T>::value, "T must be nothrow destructible");
+
+public:
+    MpscQueue()
+        : m_slot(new _T[size])
+    {
+        for (size_t i = 0; i < size; ++i)
+        {
+            m_slot[i].seq.store(i, std::memory_order_relaxed);
+        }
+    }
+
+    ~MpscQueue()
+    {
+        while (head())
+            pop();
+    }
+
+    MpscQueue(const MpscQueue &_) = delete;
+    MpscQueue &operator=(const MpscQueue &_) = delete;
+
+    bool empty()
+    {
+        return head() == nullptr;
+    }
+
+    // construct value in place, wait while queue is full
+    template <typename... Args>
+    void emplace(Args &&...args)
+    {
+        emplace_until<true>(spsc_detail::forever, std::forward<Args>(args)...);
+    }
+
+    void push(const T &val)
+    {
+        emplace(val);
+    }
+
+    void push(T &&val)
+    {
+        emplace(std::move(val));
+    }
+
+    // construct value in place only if there is room, never waits
+    template <typename... Args>
+    bool try_emplace(Args &&...args)
+    {
+        return emplace_until<false>(spsc_detail::forever, std::forward<Args>(args)...);
+    }
+
+    bool try_push(const T &val)
+    {
+        return try_emplace(val);
+    }
+
+    bool try_push(T &&val)
+    {
+        return try_emplace(std::move(val));
+    }
+
+    // wait at most `timeout` for room, return false if the queue stayed full
+    template <typename Rep, typename Period>
+    bool push_for(const T &val, const std::chrono::duration<Rep, Period> &timeout)
+    {
+        return emplace_until<true>(spsc_detail::clock::now() + timeout, val);
+    }
+
+    template <typename Rep, typename Period>
+    bool push_for(T &&val, const std::chrono::duration<Rep, Period> &timeout)
+    {
+        return emplace_until<true>(spsc_detail::clock::now() + timeout, std::move(val));
+    }
+
+    // consumer only: destroy the head value and release its slot
+    void pop()
+    {
+        auto const _head = m_head.load(std::memory_order_relaxed);
+        auto &_slot = m_slot[_head & __mask];
+        if (_slot.seq.load(std::memory_order_acquire) == _head + 1)
+        {
+            _slot.get()->~T();
+            release(_slot, _head);
+        }
+    }
+
+    // consumer only: move the head value into `val` and pop it
+    bool try_pop(T &val)
+    {
+        auto const _head = m_head.load(std::memory_order_relaxed);
+        auto &_slot = m_slot[_head & __mask];
+        if (_slot.seq.load(std::memory_order_acquire) != _head + 1)
+        {
+            return false;
+        }
+        auto _value = _slot.get();
+        val = std::move(*_value);
+        _value->~T();
+        release(_slot, _head);
+        return true;
+    }
+
+    // consumer only: wait until a value arrives, then move it into `val`
+    void pop_wait(T &val)
+    {
+        wait_not_empty(spsc_detail::forever);
+        try_pop(val);
+    }
+
+    // consumer only: wait at most `timeout` for a value
+    template <typename Rep, typename Period>
+    bool pop_for(T &val, const std::chrono::duration<Rep, Period> &timeout)
+    {
+        return wait_not_empty(spsc_detail::clock::now() + timeout) && try_pop(val);
+    }
+
+    // consumer only
+    T *head()
+    {
+        auto const _head = m_head.load(std::memory_order_relaxed);
+        auto &_slot = m_slot[_head & __mask];
+        if (_slot.seq.load(std::memory_order_acquire) != _head + 1)
+        {
+            return nullptr;
+        }
+        return _slot.get();
+    }
+
+private:
+    struct _T;
+
+    template <bool wait, typename... Args>
+    bool emplace_until(spsc_detail::clock::time_point deadline, Args &&...args)
+    {
+        // a claimed slot must always be published, or the consumer would stall on it,
+        // so a constructor that may throw runs before the claim
+        if constexpr (!std::is_nothrow_constructible<T, Args &&...>::value)
+        {
+            static_assert(std::is_nothrow_move_constructible<T>::value, "T must be nothrow move constructible");
+            return claim<wait>(deadline, T(std::forward<Args>(args)...));
+        }
+        else
+        {
+            return claim<wait>(deadline, std::forward<Args>(args)...);
+        }
+    }
+
+    template <bool wait, typename... Args>
+    bool claim(spsc_detail::clock::time_point deadline, Args &&...args)
+    {
+        auto _pos = m_tail.load(std::memory_order_relaxed);
+        _T *_slot;
+        for (;;)
+        {
+            _slot = &m_slot[_pos & __mask];
+            auto const _seq = _slot->seq.load(std::memory_order_acquire);
+            auto const _diff = static_cast<intptr_t>(_seq) - static_cast<intptr_t>(_pos);
+            if (_diff == 0)
+            {
+                if (m_tail.compare_exchange_weak(_pos, _pos + 1, std::memory_order_relaxed))
+                    break;
+            }
+            else if (_diff < 0)
+            {
+                // the slot still holds the value from one lap ago: full
+                auto _ready = [&]
+                { return _slot->seq.load(std::memory_order_acquire) != _seq; };
+                if (!wait || !m_not_full.wait(_ready, deadline))
+                    return false;
+                _pos = m_tail.load(std::memory_order_relaxed);
+            }
+            else
+            {
+                _pos = m_tail.load(std::memory_order_relaxed);
+            }
+        }
+
+        new (_slot->storage) T(std::forward<Args>(args)...);
+        _slot->seq.store(_pos + 1, std::memory_order_release);
+        m_not_empty.notify();
+        return true;
+    }
+
+    void release(_T &slot, size_t head)
+    {
+        slot.seq.store(head + size, std::memory_order_release);
+        m_head.store(head + 1, std::memory_order_relaxed);
+        m_not_full.notify();
+    }
+
+    bool wait_not_empty(spsc_detail::clock::time_point deadline)
+    {
+        auto const _head = m_head.load(std::memory_order_relaxed);
+        auto &_slot = m_slot[_head & __mask];
+        auto _ready = [&]
+        { return _slot.seq.load(std::memory_order_acquire) == _head + 1; };
+        return _ready() || m_not_empty.wait(_ready, deadline);
+    }
+
+#ifdef __cpp_lib_hardware_interference_size
+    static constexpr size_t __chache_line_size =
+        std::hardware_destructive_interference_size;
+#else
+    static constexpr size_t __chache_line_size = 64;
+#endif
+
+    static constexpr size_t __mask = size - 1;
+
+    struct alignas(__chache_line_size) _T
+    {
+        std::atomic<size_t> seq;
+        alignas(T) unsigned char storage[sizeof(T)];
+
+        T *get()
+        {
+            return std::launder(reinterpret_cast<T *>(storage));
+        }
+    };
+
+    alignas(__chache_line_size) std::unique_ptr<_T[]> m_slot;
+    // only the consumer touches the head
+    alignas(__chache_line_size) std::atomic<size_t> m_head{0};
+    alignas(__chache_line_size) std::atomic<size_t> m_tail{0};
+
+    // producers wait on m_not_full, the consumer waits on m_not_empty
+    alignas(__chache_line_size) Wait m_not_full;
+    alignas(__chache_line_size) Wait m_not_empty;
+};
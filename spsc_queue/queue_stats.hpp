@@ -0,0 +1,101 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <new>
+#include <stdint.h>
+
+// Stats policies for SpscQueue. The queue calls the on_* hooks from the
+// side that owns them; NoStats compiles every hook away.
+
+// point in time copy of the counters, safe to take from any thread
+struct SpscStats
+{
+    uint64_t pushes = 0;
+    uint64_t pops = 0;
+    uint64_t full_spins = 0;  // producer polls while the queue was full
+    uint64_t empty_polls = 0; // consumer polls that found the queue empty
+    uint64_t high_water = 0;  // deepest the queue has been, in elements
+};
+
+class NoStats
+{
+protected:
+    void on_push(size_t) {}
+    void on_full_spin() {}
+    void on_pop() {}
+    void on_empty_poll() {}
+
+public:
+    SpscStats stats() const { return SpscStats(); }
+};
+
+class QueueStats
+{
+protected:
+    // every counter has a single writer, so a relaxed load + store replaces
+    // a locked read-modify-write
+
+    void on_push(size_t depth)
+    {
+        bump(m_producer.pushes);
+        if (depth > m_producer.high_water.load(std::memory_order_relaxed))
+            m_producer.high_water.store(depth, std::memory_order_relaxed);
+    }
+
+    void on_full_spin()
+    {
+        bump(m_producer.full_spins);
+    }
+
+    void on_pop()
+    {
+        bump(m_consumer.pops);
+    }
+
+    void on_empty_poll()
+    {
+        bump(m_consumer.empty_polls);
+    }
+
+public:
+    SpscStats stats() const
+    {
+        SpscStats _stats;
+        _stats.pushes = m_producer.pushes.load(std::memory_order_relaxed);
+        _stats.full_spins = m_producer.full_spins.load(std::memory_order_relaxed);
+        _stats.high_water = m_producer.high_water.load(std::memory_order_relaxed);
+        _stats.pops = m_consumer.pops.load(std::memory_order_relaxed);
+        _stats.empty_polls = m_consumer.empty_polls.load(std::memory_order_relaxed);
+        return _stats;
+    }
+
+private:
+    static void bump(std::atomic<uint64_t> &counter)
+    {
+        counter.store(counter.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    }
+
+#ifdef __cpp_lib_hardware_interference_size
+    static constexpr size_t __chache_line_size =
+        std::hardware_destructive_interference_size;
+#else
+    static constexpr size_t __chache_line_size = 64;
+#endif
+
+    struct alignas(__chache_line_size) _Producer
+    {
+        std::atomic<uint64_t> pushes{0};
+        std::atomic<uint64_t> full_spins{0};
+        std::atomic<uint64_t> high_water{0};
+    };
+
+    struct alignas(__chache_line_size) _Consumer
+    {
+        std::atomic<uint64_t> pops{0};
+        std::atomic<uint64_t> empty_polls{0};
+    };
+
+    _Producer m_producer;
+    _Consumer m_consumer;
+};
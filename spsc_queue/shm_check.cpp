@@ -0,0 +1,188 @@
+// Crash and ownership checks for ShmSpscQueue, with fork()ed peers (POSIX only).
+//
+//   g++ -std=c++17 -g -fsanitize=address,undefined shm_check.cpp -o shm_check && ./shm_check
+//
+// Prints the failed checks and exits with 1 if there are any.
+
+#include "shm_queue.hpp"
+
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <sys/wait.h>
+#include <unistd.h>
+
+namespace
+{
+    int failures = 0;
+
+    void check(bool ok, const char *what, int line)
+    {
+        if (!ok)
+        {
+            std::fprintf(stderr, "line %d: %s\n", line, what);
+            ++failures;
+        }
+    }
+
+#define CHECK(expr) check((expr), #expr, __LINE__)
+
+    using Queue = ShmSpscQueue<uint64_t, 64>;
+
+    // a child that binds the producer side, says so through the queue and waits to be killed
+    pid_t start_producer(Queue &queue)
+    {
+        auto _child = fork();
+        if (_child == 0)
+        {
+            if (queue.bind(ShmSide::Producer) != ShmError::Success || !queue.try_push(1))
+                _exit(1);
+            for (;;)
+                pause();
+        }
+        return _child;
+    }
+
+    bool wait_for_value(Queue &queue)
+    {
+        uint64_t _value = 0;
+        for (int _i = 0; _i < 5000 && !queue.try_pop(_value); ++_i)
+            usleep(1000);
+        return _value == 1;
+    }
+
+    void crashed_peer()
+    {
+        Queue _queue;
+        CHECK(_queue.create() == ShmError::Success);
+        CHECK(_queue.bind(ShmSide::Consumer) == ShmError::Success);
+        CHECK(_queue.peer() == ShmPeer::Absent);
+
+        auto _child = start_producer(_queue);
+        CHECK(wait_for_value(_queue));
+        CHECK(_queue.peer() == ShmPeer::Alive);
+
+        // dead once it is gone, before the parent reaps it (a zombie) and after
+        kill(_child, SIGKILL);
+        for (int _i = 0; _i < 5000 && _queue.peer() == ShmPeer::Alive; ++_i)
+            usleep(1000);
+        CHECK(_queue.peer() == ShmPeer::Dead);
+        waitpid(_child, nullptr, 0);
+        CHECK(_queue.peer() == ShmPeer::Dead);
+
+        // a dead side can be taken over, a live one cannot
+        auto _next = start_producer(_queue);
+        CHECK(wait_for_value(_queue));
+        CHECK(_queue.peer() == ShmPeer::Alive);
+        CHECK(_queue.bind(ShmSide::Producer) == ShmError::SideTaken);
+        kill(_next, SIGKILL);
+        waitpid(_next, nullptr, 0);
+    }
+
+    void closed_peer()
+    {
+        Queue _queue;
+        CHECK(_queue.create() == ShmError::Success);
+        CHECK(_queue.bind(ShmSide::Consumer) == ShmError::Success);
+
+        auto _child = fork();
+        if (_child == 0)
+        {
+            auto _ok = _queue.bind(ShmSide::Producer) == ShmError::Success && _queue.try_push(1);
+            _queue.close();
+            _exit(_ok ? 0 : 1);
+        }
+        int _status = 0;
+        waitpid(_child, &_status, 0);
+        CHECK(WIFEXITED(_status) && WEXITSTATUS(_status) == 0);
+        CHECK(_queue.peer() == ShmPeer::Closed);
+        CHECK(wait_for_value(_queue));
+    }
+
+    // children race for the producer side, exactly one may get it
+    void bind_race()
+    {
+        constexpr int children = 8;
+        Queue _queue;
+        CHECK(_queue.create() == ShmError::Success);
+
+        int _pipe[2];
+        CHECK(pipe(_pipe) == 0);
+        pid_t _children[children];
+        for (auto &_child : _children)
+        {
+            _child = fork();
+            if (_child == 0)
+            {
+                ::close(_pipe[1]);
+                char _go;
+                if (read(_pipe[0], &_go, 1) != 0) // released together when the pipe closes
+                    _exit(2);
+                if (_queue.bind(ShmSide::Producer) != ShmError::Success)
+                    _exit(1);
+                usleep(200000); // stay alive while the others try
+                _exit(0);
+            }
+        }
+        ::close(_pipe[0]);
+        ::close(_pipe[1]);
+
+        int _winners = 0;
+        for (auto _child : _children)
+        {
+            int _status = 0;
+            waitpid(_child, &_status, 0);
+            _winners += WIFEXITED(_status) && WEXITSTATUS(_status) == 0;
+        }
+        CHECK(_winners == 1);
+    }
+
+    // create() must not wipe a named queue a live process is bound to
+    void named_create()
+    {
+        auto const _name = "/shm_check_" + std::to_string(getpid());
+        Queue _owner;
+        CHECK(_owner.create(_name, ShmSide::Consumer) == ShmError::Success);
+
+        auto _child = fork();
+        if (_child == 0)
+        {
+            Queue _other;
+            _exit(_other.create(_name, ShmSide::Producer) == ShmError::InUse ? 0 : 1);
+        }
+        int _status = 0;
+        waitpid(_child, &_status, 0);
+        CHECK(WIFEXITED(_status) && WEXITSTATUS(_status) == 0);
+
+        // a creator that crashed leaves its segment behind, it can be created again
+        auto _stale = "/shm_check_stale_" + std::to_string(getpid());
+        _child = fork();
+        if (_child == 0)
+        {
+            Queue _crashed;
+            _exit(_crashed.create(_stale, ShmSide::Producer) == ShmError::Success ? 0 : 1); // never unlinks
+        }
+        waitpid(_child, &_status, 0);
+        CHECK(WIFEXITED(_status) && WEXITSTATUS(_status) == 0);
+
+        Queue _again;
+        CHECK(_again.create(_stale, ShmSide::Producer) == ShmError::Success);
+        CHECK(_again.empty());
+    }
+}
+
+int main()
+{
+    crashed_peer();
+    closed_peer();
+    bind_race();
+    named_create();
+
+    if (failures != 0)
+    {
+        std::fprintf(stderr, "%d checks failed\n", failures);
+        return 1;
+    }
+    std::printf("ok\n");
+    return 0;
+}
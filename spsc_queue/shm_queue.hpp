@@ -0,0 +1,574 @@
+#pragma once
+
+#include <atomic>
+#include <cstdio>
+#include <cstring>
+#include <stdint.h>
+#include <string>
+#include <type_traits>
+
+#if defined(_WIN32)
+#define WIN32_LEAN_AND_MEAN
+#include <Windows.h>
+#else
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include "wait_policy.hpp"
+
+// SPSC queue whose header and slots live in a shared memory mapping, for
+// handing values between two processes on one host.
+//
+//   producer process:  ShmSpscQueue<Frame> q; q.create("/frames", ShmSide::Producer); q.push(frame);
+//   consumer process:  ShmSpscQueue<Frame> q; q.attach("/frames", ShmSide::Consumer); q.try_pop(frame);
+//
+// Nothing in the mapping is a pointer: head and tail are ever growing
+// positions and slot = position % size, so every process may map it at a
+// different address. T is copied byte-wise and must be trivially copyable.
+// Each side records its pid, so the other one can tell a clean close from a crash.
+
+enum class ShmSide
+{
+    Producer,
+    Consumer
+};
+
+enum class ShmPeer
+{
+    Absent, // never attached
+    Alive,
+    Closed, // detached cleanly
+    Dead    // process is gone without detaching
+};
+
+enum class ShmError
+{
+    Success,
+    MapFailed,
+    InvalidMagic,
+    VersionMismatch,
+    CapacityMismatch,
+    SideTaken,
+    InUse // create(): a live process still has the named queue
+};
+
+template <typename T, size_t size = 1024>
+class ShmSpscQueue
+{
+    static_assert(std::is_trivially_copyable<T>::value, "T must be trivially copyable to cross processes");
+    static_assert(std::atomic<uint64_t>::is_always_lock_free, "shared atomics must be lock free");
+
+public:
+    static constexpr uint32_t version = 2;
+
+    ShmSpscQueue() = default;
+
+    ~ShmSpscQueue()
+    {
+        close();
+    }
+
+    ShmSpscQueue(const ShmSpscQueue &_) = delete;
+    ShmSpscQueue &operator=(const ShmSpscQueue &_) = delete;
+
+    // create the named mapping, initialise it and take `side`. A mapping left
+    // over by processes that are all gone is reused, one a live process is
+    // bound to is left alone and fails with InUse. Create a name from one
+    // process only, the other side attaches.
+    ShmError create(const std::string &name, ShmSide side)
+    {
+        auto _error = map(name, true);
+        if (_error != ShmError::Success)
+        {
+            return _error;
+        }
+        initialize();
+        return bind(side);
+    }
+
+    // map an existing queue, validate its header and take `side`
+    ShmError attach(const std::string &name, ShmSide side)
+    {
+        auto _error = map(name, false);
+        if (_error != ShmError::Success)
+        {
+            return _error;
+        }
+        return bind(side);
+    }
+
+#if !defined(_WIN32)
+    // unnamed mapping that survives fork(), each process then calls bind():
+    //
+    //   q.create();
+    //   if (fork() == 0) { q.bind(ShmSide::Producer); ...; _exit(0); }
+    //   q.bind(ShmSide::Consumer);
+    //   while (q.peer() != ShmPeer::Dead && q.peer() != ShmPeer::Closed) ...
+    //   waitpid(child, ...);
+    //
+    // A child that crashes reads as Dead as soon as it exits, the parent does
+    // not have to reap it first.
+    ShmError create()
+    {
+        auto _addr = mmap(nullptr, __map_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+        if (_addr == MAP_FAILED)
+        {
+            return ShmError::MapFailed;
+        }
+        m_header = static_cast<_Header *>(_addr);
+        initialize();
+        return ShmError::Success;
+    }
+#endif
+
+    // register the calling process as `side`, fails if a live process holds it.
+    // State and pid change in one CAS, so of two processes binding at once only one wins.
+    ShmError bind(ShmSide side)
+    {
+        auto &_peer = side == ShmSide::Producer ? m_header->producer : m_header->consumer;
+        auto _word = _peer.load(std::memory_order_acquire);
+        do
+        {
+            if (state_of(_word) == __alive && process_alive(pid_of(_word)))
+            {
+                return ShmError::SideTaken;
+            }
+        } while (!_peer.compare_exchange_weak(_word, pack(current_pid(), __alive), std::memory_order_acq_rel, std::memory_order_acquire));
+        m_side = side;
+        m_bound = true;
+        return ShmError::Success;
+    }
+
+    // mark our side closed and unmap, the mapping stays alive for the peer
+    void close()
+    {
+        if (!m_header)
+        {
+            return;
+        }
+        if (m_bound)
+        {
+            auto &_self = m_side == ShmSide::Producer ? m_header->producer : m_header->consumer;
+            _self.store(pack(current_pid(), __closed), std::memory_order_release);
+            m_bound = false;
+        }
+#if defined(_WIN32)
+        UnmapViewOfFile(m_header);
+        CloseHandle(m_mapping);
+        m_mapping = nullptr;
+#else
+        munmap(m_header, __map_size);
+        if (m_owner)
+        {
+            shm_unlink(m_name.c_str());
+        }
+#endif
+        m_header = nullptr;
+        m_owner = false;
+    }
+
+    // state of the other side of the queue
+    ShmPeer peer()
+    {
+        auto const _word = (m_side == ShmSide::Producer ? m_header->consumer : m_header->producer).load(std::memory_order_acquire);
+        switch (state_of(_word))
+        {
+        case __alive:
+            return process_alive(pid_of(_word)) ? ShmPeer::Alive : ShmPeer::Dead;
+        case __closed:
+            return ShmPeer::Closed;
+        default:
+            return ShmPeer::Absent;
+        }
+    }
+
+    bool empty()
+    {
+        return m_header->head.load(std::memory_order_acquire) ==
+               m_header->tail.load(std::memory_order_acquire);
+    }
+
+    // producer: copy `val` in if there is room, never waits
+    bool try_push(const T &val)
+    {
+        auto const _tail = m_header->tail.load(std::memory_order_relaxed);
+        if (_tail - m_header->head.load(std::memory_order_acquire) == size)
+        {
+            return false;
+        }
+        std::memcpy(slot(_tail), &val, sizeof(T));
+        m_header->tail.store(_tail + 1, std::memory_order_release);
+        return true;
+    }
+
+    // producer: spin while full, give up once the consumer is dead or closed
+    bool push(const T &val)
+    {
+        for (uint32_t _i = 1; !try_push(val); ++_i)
+        {
+            spsc_detail::cpu_relax();
+            if ((_i & 4095) == 0)
+            {
+                auto _peer = peer();
+                if (_peer == ShmPeer::Closed || _peer == ShmPeer::Dead)
+                    return false;
+            }
+        }
+        return true;
+    }
+
+    // consumer: the head value, valid until pop()
+    const T *head()
+    {
+        auto const _head = m_header->head.load(std::memory_order_relaxed);
+        if (_head == m_header->tail.load(std::memory_order_acquire))
+        {
+            return nullptr;
+        }
+        return slot(_head);
+    }
+
+    // consumer
+    void pop()
+    {
+        auto const _head = m_header->head.load(std::memory_order_relaxed);
+        if (_head != m_header->tail.load(std::memory_order_acquire))
+        {
+            m_header->head.store(_head + 1, std::memory_order_release);
+        }
+    }
+
+    // consumer: copy the head value into `val` and pop it
+    bool try_pop(T &val)
+    {
+        auto _value = head();
+        if (!_value)
+        {
+            return false;
+        }
+        std::memcpy(&val, _value, sizeof(T));
+        pop();
+        return true;
+    }
+
+private:
+    static constexpr uint64_t __magic = 0x5350534353484D51; // "SPSCSHMQ"
+    static constexpr uint32_t __alive = 1;
+    static constexpr uint32_t __closed = 2;
+    // fixed rather than hardware_destructive_interference_size: both processes must agree on the layout
+    static constexpr size_t __chache_line_size = 64;
+
+    // pid << 32 | state of one side, in one word so bind() can claim it with a CAS
+    using _Peer = std::atomic<uint64_t>;
+
+    static constexpr uint64_t pack(uint32_t pid, uint32_t state)
+    {
+        return uint64_t(pid) << 32 | state;
+    }
+
+    static constexpr uint32_t pid_of(uint64_t word)
+    {
+        return static_cast<uint32_t>(word >> 32);
+    }
+
+    static constexpr uint32_t state_of(uint64_t word)
+    {
+        return static_cast<uint32_t>(word);
+    }
+
+    struct _Header
+    {
+        std::atomic<uint64_t> magic;
+        uint32_t version;
+        uint32_t slot_size;
+        uint64_t capacity;
+
+        alignas(__chache_line_size) std::atomic<uint64_t> head;
+        _Peer consumer;
+
+        alignas(__chache_line_size) std::atomic<uint64_t> tail;
+        _Peer producer;
+    };
+
+    static constexpr size_t __slot_offset = (sizeof(_Header) + __chache_line_size - 1) & ~(__chache_line_size - 1);
+    static constexpr size_t __map_size = __slot_offset + sizeof(T) * size;
+
+    T *slot(uint64_t pos)
+    {
+        auto _base = reinterpret_cast<uint8_t *>(m_header) + __slot_offset;
+        return reinterpret_cast<T *>(_base) + pos % size;
+    }
+
+    void initialize()
+    {
+        // the mapping starts zeroed, magic is published last so attach never sees half a header
+        m_header->version = version;
+        m_header->slot_size = sizeof(T);
+        m_header->capacity = size;
+        m_header->head.store(0, std::memory_order_relaxed);
+        m_header->tail.store(0, std::memory_order_relaxed);
+        m_header->producer.store(0, std::memory_order_relaxed);
+        m_header->consumer.store(0, std::memory_order_relaxed);
+        m_header->magic.store(__magic, std::memory_order_release);
+    }
+
+    static ShmError validate(const _Header *header)
+    {
+        if (header->magic.load(std::memory_order_acquire) != __magic)
+        {
+            return ShmError::InvalidMagic;
+        }
+        if (header->version != version)
+        {
+            return ShmError::VersionMismatch;
+        }
+        if (header->capacity != size || header->slot_size != sizeof(T))
+        {
+            return ShmError::CapacityMismatch;
+        }
+        return ShmError::Success;
+    }
+
+    // whether a live process may be bound to an existing mapping; one of
+    // another layout is assumed to be in use, one without a header is not
+    static bool in_use(const _Header *header)
+    {
+        if (header->magic.load(std::memory_order_acquire) != __magic)
+        {
+            return false;
+        }
+        if (validate(header) != ShmError::Success)
+        {
+            return true;
+        }
+        for (auto _peer : {&header->producer, &header->consumer})
+        {
+            auto const _word = _peer->load(std::memory_order_acquire);
+            if (state_of(_word) == __alive && process_alive(pid_of(_word)))
+            {
+                return true;
+            }
+        }
+        return false;
+    }
+
+#if defined(_WIN32)
+    ShmError map(const std::string &name, bool create)
+    {
+        if (create)
+        {
+            m_mapping = CreateFileMappingA(INVALID_HANDLE_VALUE, NULL, PAGE_READWRITE,
+                                           static_cast<DWORD>(uint64_t(__map_size) >> 32),
+                                           static_cast<DWORD>(__map_size), name.c_str());
+        }
+        else
+        {
+            m_mapping = OpenFileMappingA(FILE_MAP_ALL_ACCESS, FALSE, name.c_str());
+        }
+        if (!m_mapping)
+        {
+            return ShmError::MapFailed;
+        }
+        // the name is taken while any process has the section open, initialize() must not reset a live queue
+        auto const _existed = create && GetLastError() == ERROR_ALREADY_EXISTS;
+
+        if (_existed)
+        {
+            auto _header = static_cast<const _Header *>(MapViewOfFile(m_mapping, FILE_MAP_READ, 0, 0, sizeof(_Header)));
+            auto _busy = !_header || in_use(_header);
+            if (_header)
+                UnmapViewOfFile(_header);
+            if (_busy)
+            {
+                CloseHandle(m_mapping);
+                m_mapping = nullptr;
+                return ShmError::InUse;
+            }
+        }
+
+        if (!create)
+        {
+            // look at the header alone first, the section may be smaller than we expect
+            auto _header = static_cast<const _Header *>(MapViewOfFile(m_mapping, FILE_MAP_READ, 0, 0, sizeof(_Header)));
+            auto _error = _header ? validate(_header) : ShmError::MapFailed;
+            if (_header)
+                UnmapViewOfFile(_header);
+            if (_error != ShmError::Success)
+            {
+                CloseHandle(m_mapping);
+                m_mapping = nullptr;
+                return _error;
+            }
+        }
+
+        m_header = static_cast<_Header *>(MapViewOfFile(m_mapping, FILE_MAP_ALL_ACCESS, 0, 0, __map_size));
+        if (!m_header)
+        {
+            CloseHandle(m_mapping);
+            m_mapping = nullptr;
+            return ShmError::MapFailed;
+        }
+        return ShmError::Success;
+    }
+
+    static uint32_t current_pid()
+    {
+        return GetCurrentProcessId();
+    }
+
+    static bool process_alive(uint32_t pid)
+    {
+        HANDLE _process = OpenProcess(SYNCHRONIZE, FALSE, pid);
+        if (!_process)
+        {
+            return false;
+        }
+        bool _alive = WaitForSingleObject(_process, 0) == WAIT_TIMEOUT;
+        CloseHandle(_process);
+        return _alive;
+    }
+
+    HANDLE m_mapping = nullptr;
+#else
+    ShmError map(const std::string &name, bool create)
+    {
+        int _fd = shm_open(name.c_str(), O_RDWR | (create ? O_CREAT | O_EXCL : 0), 0600);
+        if (_fd < 0 && create && errno == EEXIST)
+        {
+            // a segment outlives a crashed owner; take its name over only when nobody uses it
+            if (!stale(name))
+            {
+                return ShmError::InUse;
+            }
+            shm_unlink(name.c_str());
+            _fd = shm_open(name.c_str(), O_RDWR | O_CREAT | O_EXCL, 0600);
+        }
+        if (_fd < 0)
+        {
+            return ShmError::MapFailed;
+        }
+        if (create && ftruncate(_fd, __map_size) != 0)
+        {
+            ::close(_fd);
+            shm_unlink(name.c_str());
+            return ShmError::MapFailed;
+        }
+
+        if (!create)
+        {
+            // look at the header alone first, the segment may be smaller than we expect
+            struct stat _stat;
+            if (fstat(_fd, &_stat) != 0 || static_cast<size_t>(_stat.st_size) < sizeof(_Header))
+            {
+                ::close(_fd);
+                return ShmError::InvalidMagic;
+            }
+            auto _addr = mmap(nullptr, sizeof(_Header), PROT_READ, MAP_SHARED, _fd, 0);
+            auto _error = _addr == MAP_FAILED ? ShmError::MapFailed : validate(static_cast<const _Header *>(_addr));
+            if (_addr != MAP_FAILED)
+                munmap(_addr, sizeof(_Header));
+            if (_error == ShmError::Success && static_cast<size_t>(_stat.st_size) < __map_size)
+                _error = ShmError::CapacityMismatch;
+            if (_error != ShmError::Success)
+            {
+                ::close(_fd);
+                return _error;
+            }
+        }
+
+        auto _addr = mmap(nullptr, __map_size, PROT_READ | PROT_WRITE, MAP_SHARED, _fd, 0);
+        ::close(_fd);
+        if (_addr == MAP_FAILED)
+        {
+            return ShmError::MapFailed;
+        }
+
+        m_header = static_cast<_Header *>(_addr);
+        m_owner = create;
+        m_name = name;
+        return ShmError::Success;
+    }
+
+    static bool stale(const std::string &name)
+    {
+        int _fd = shm_open(name.c_str(), O_RDONLY, 0);
+        if (_fd < 0)
+        {
+            return errno == ENOENT;
+        }
+        struct stat _stat;
+        bool _stale = false;
+        if (fstat(_fd, &_stat) == 0)
+        {
+            if (static_cast<size_t>(_stat.st_size) < sizeof(_Header))
+            {
+                _stale = true;
+            }
+            else
+            {
+                auto _addr = mmap(nullptr, sizeof(_Header), PROT_READ, MAP_SHARED, _fd, 0);
+                if (_addr != MAP_FAILED)
+                {
+                    _stale = !in_use(static_cast<const _Header *>(_addr));
+                    munmap(_addr, sizeof(_Header));
+                }
+            }
+        }
+        ::close(_fd);
+        return _stale;
+    }
+
+    static uint32_t current_pid()
+    {
+        return static_cast<uint32_t>(getpid());
+    }
+
+    static bool process_alive(uint32_t pid)
+    {
+        if (kill(static_cast<pid_t>(pid), 0) != 0 && errno != EPERM)
+        {
+            return false;
+        }
+#if defined(__linux__)
+        // a child that exited stays a zombie until its parent reaps it, and
+        // kill() still finds it; the state letter in /proc tells them apart
+        char _path[32];
+        std::snprintf(_path, sizeof(_path), "/proc/%u/stat", pid);
+        int _fd = ::open(_path, O_RDONLY | O_CLOEXEC);
+        if (_fd < 0)
+        {
+            return errno != ENOENT;
+        }
+        char _stat[256];
+        auto _read = ::read(_fd, _stat, sizeof(_stat) - 1);
+        ::close(_fd);
+        if (_read <= 0)
+        {
+            return false;
+        }
+        _stat[_read] = 0;
+        // "pid (comm) S ...", comm may hold ')' itself
+        auto _comm_end = std::strrchr(_stat, ')');
+        if (!_comm_end || _comm_end[1] != ' ')
+        {
+            return true;
+        }
+        return _comm_end[2] != 'Z' && _comm_end[2] != 'X';
+#else
+        return true;
+#endif
+    }
+
+    std::string m_name;
+#endif
+
+    _Header *m_header = nullptr;
+    ShmSide m_side = ShmSide::Producer;
+    bool m_bound = false;
+    bool m_owner = false;
+};
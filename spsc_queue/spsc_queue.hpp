@@ -1,20 +1,65 @@
 #pragma once
 
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
 #include <memory>
+#include <new>
+#include <type_traits>
+#include <utility>
 #include <vector>
-#include <atomic>
 
-template <typename T, size_t size = 1024>
-class SpscQueue
+#include "queue_stats.hpp"
+#include "wait_policy.hpp"
+
+// where the slots live and how they are padded
+enum class SlotStorage
+{
+    Heap,  // std::vector, capacity does not grow the queue object
+    Inline // std::array inside the queue object, no indirection
+};
+
+enum class SlotPadding
+{
+    Slot,  // every slot on its own cache line, no false sharing between neighbours
+    Packed // slots packed by alignof(T), only head and tail are padded
+};
+
+template <SlotStorage storage = SlotStorage::Heap, SlotPadding padding = SlotPadding::Slot>
+struct SlotLayout
+{
+    static constexpr SlotStorage slot_storage = storage;
+    static constexpr SlotPadding slot_padding = padding;
+};
+
+// small element queues that should stay in L1
+using DenseLayout = SlotLayout<SlotStorage::Inline, SlotPadding::Packed>;
+
+template <typename T, size_t size = 1024, typename Wait = SpinWait, typename Layout = SlotLayout<>, typename Stats = NoStats>
+class SpscQueue : private Stats
 {
 
 public:
+    // snapshot of the counters, all zero with NoStats
+    using Stats::stats;
+
     SpscQueue()
     {
-        m_slot.resize(m_size);
+        if constexpr (Layout::slot_storage == SlotStorage::Heap)
+        {
+            m_slot.resize(m_size);
+        }
+    }
+
+    ~SpscQueue()
+    {
+        while (head())
+            pop();
     }
 
     SpscQueue(const SpscQueue &_) = delete;
+    SpscQueue &operator=(const SpscQueue &_) = delete;
 
     bool empty()
     {
@@ -22,38 +67,175 @@ public:
                m_tail.load(std::memory_order_acquire);
     }
 
+    // construct value in place at the tail slot, wait while queue is full
+    template <typename... Args>
+    void emplace(Args &&...args)
+    {
+        emplace_until(spsc_detail::forever, std::forward<Args>(args)...);
+    }
+
     void push(const T &val)
     {
-        static_assert(std::is_nothrow_copy_constructible<T>::value, "T must be nothrow destructible");
+        emplace(val);
+    }
+
+    void push(T &&val)
+    {
+        emplace(std::move(val));
+    }
+
+    // construct value in place only if there is room, never waits
+    template <typename... Args>
+    bool try_emplace(Args &&...args)
+    {
         auto const _tail = m_tail.load(std::memory_order_relaxed);
-        auto _next = (_tail + 1) % m_size;
-        while (_next == m_head.load(std::memory_order_acquire))
-            ;
-        m_slot[_tail].value = val;
-        m_tail.store(_next, std::memory_order_release);
+        auto _next = next(_tail);
+        auto const _head = m_head.load(std::memory_order_acquire);
+        if (_next == _head)
+        {
+            this->on_full_spin();
+            return false;
+        }
+        publish(_tail, _next, _head, std::forward<Args>(args)...);
+        return true;
     }
 
+    bool try_push(const T &val)
+    {
+        return try_emplace(val);
+    }
+
+    bool try_push(T &&val)
+    {
+        return try_emplace(std::move(val));
+    }
+
+    // wait at most `timeout` for room, return false if the queue stayed full
+    template <typename Rep, typename Period>
+    bool push_for(const T &val, const std::chrono::duration<Rep, Period> &timeout)
+    {
+        return emplace_until(spsc_detail::clock::now() + timeout, val);
+    }
+
+    template <typename Rep, typename Period>
+    bool push_for(T &&val, const std::chrono::duration<Rep, Period> &timeout)
+    {
+        return emplace_until(spsc_detail::clock::now() + timeout, std::move(val));
+    }
+
+    // destroy the head value and release its slot to the producer
     void pop()
     {
         auto const _head = m_head.load(std::memory_order_relaxed);
-        auto _next = (_head + 1) % m_size;
+        auto _next = next(_head);
         if (_head != m_tail.load(std::memory_order_acquire))
         {
+            m_slot[_head].get()->~T();
             m_head.store(_next, std::memory_order_release);
+            m_not_full.notify();
+            this->on_pop();
+        }
+        else
+        {
+            this->on_empty_poll();
         }
     }
 
+    // move the head value into `val` and pop it, return false if queue is empty
+    bool try_pop(T &val)
+    {
+        auto const _head = m_head.load(std::memory_order_relaxed);
+        if (_head == m_tail.load(std::memory_order_acquire))
+        {
+            this->on_empty_poll();
+            return false;
+        }
+        auto _value = m_slot[_head].get();
+        val = std::move(*_value);
+        _value->~T();
+        m_head.store(next(_head), std::memory_order_release);
+        m_not_full.notify();
+        this->on_pop();
+        return true;
+    }
+
+    // wait until a value arrives, then move it into `val` and pop it
+    void pop_wait(T &val)
+    {
+        wait_not_empty(spsc_detail::forever);
+        try_pop(val);
+    }
+
+    // wait at most `timeout` for a value, return false if the queue stayed empty
+    template <typename Rep, typename Period>
+    bool pop_for(T &val, const std::chrono::duration<Rep, Period> &timeout)
+    {
+        return wait_not_empty(spsc_detail::clock::now() + timeout) && try_pop(val);
+    }
+
     T *head()
     {
         auto const _head = m_head.load(std::memory_order_relaxed);
         if (_head == m_tail.load(std::memory_order_acquire))
         {
+            this->on_empty_poll();
             return nullptr;
         }
-        return &m_slot[_head].value;
+        return m_slot[_head].get();
     }
 
 private:
+    template <typename... Args>
+    bool emplace_until(spsc_detail::clock::time_point deadline, Args &&...args)
+    {
+        auto const _tail = m_tail.load(std::memory_order_relaxed);
+        auto _next = next(_tail);
+        auto _head = m_head.load(std::memory_order_acquire);
+        if (_next == _head)
+        {
+            // like wait_not_empty, only the polls that still find the queue full count
+            this->on_full_spin();
+            auto _ready = [&]
+            {
+                _head = m_head.load(std::memory_order_acquire);
+                if (_next != _head)
+                    return true;
+                this->on_full_spin();
+                return false;
+            };
+            if (!m_not_full.wait(_ready, deadline))
+            {
+                return false;
+            }
+        }
+        publish(_tail, _next, _head, std::forward<Args>(args)...);
+        return true;
+    }
+
+    template <typename... Args>
+    void publish(size_t _tail, size_t _next, size_t _head, Args &&...args)
+    {
+        // if the constructor throws, tail is not published and the slot stays raw
+        new (m_slot[_tail].storage) T(std::forward<Args>(args)...);
+        m_tail.store(_next, std::memory_order_release);
+        m_not_empty.notify();
+        // depth against the last head we saw, the consumer may be ahead of it already
+        this->on_push(_next >= _head ? _next - _head : _next + m_size - _head);
+    }
+
+    bool wait_not_empty(spsc_detail::clock::time_point deadline)
+    {
+        auto const _head = m_head.load(std::memory_order_relaxed);
+        auto _ready = [&]
+        {
+            if (_head != m_tail.load(std::memory_order_acquire))
+                return true;
+            this->on_empty_poll();
+            return false;
+        };
+        return _ready() || m_not_empty.wait(_ready, deadline);
+    }
+
 #ifdef __cpp_lib_hardware_interference_size
     static constexpr size_t __chache_line_size =
         std::hardware_destructive_interference_size;
@@ -61,14 +243,44 @@ private:
     static constexpr size_t __chache_line_size = 64;
 #endif
 
-    static constexpr size_t m_size = std::max(2ULL, size);
+    static constexpr size_t m_size = std::max<size_t>(2, size);
+
+    static constexpr size_t next(size_t index)
+    {
+        if constexpr ((m_size & (m_size - 1)) == 0)
+        {
+            return (index + 1) & (m_size - 1);
+        }
+        else
+        {
+            // a compare is cheaper than the division `%` would need
+            return index + 1 == m_size ? 0 : index + 1;
+        }
+    }
+
+    static constexpr size_t __slot_align =
+        Layout::slot_padding == SlotPadding::Slot ? std::max(__chache_line_size, alignof(T)) : alignof(T);
 
-    struct alignas(__chache_line_size) _T
+    // raw storage, a value only lives here between emplace and pop
+    struct alignas(__slot_align) _T
     {
-        T value;
+        alignas(T) unsigned char storage[sizeof(T)];
+
+        T *get()
+        {
+            return std::launder(reinterpret_cast<T *>(storage));
+        }
     };
 
-    alignas(__chache_line_size) std::vector<_T> m_slot;
+    using _Slots = typename std::conditional<Layout::slot_storage == SlotStorage::Inline,
+                                             std::array<_T, m_size>,
+                                             std::vector<_T>>::type;
+
+    alignas(__chache_line_size) _Slots m_slot;
     alignas(__chache_line_size) std::atomic<size_t> m_head{0};
     alignas(__chache_line_size) std::atomic<size_t> m_tail{0};
-};
\ No newline at end of file
+
+    // producer waits on m_not_full, consumer waits on m_not_empty
+    alignas(__chache_line_size) Wait m_not_full;
+    alignas(__chache_line_size) Wait m_not_empty;
+};
@@ -0,0 +1,199 @@
+#pragma once
+
+#include <atomic>
+#include <cassert>
+#include <cstring>
+#include <stdint.h>
+#include <vector>
+
+// Byte oriented SPSC ring for variable length records.
+//
+// producer:  auto buf = ring.reserve(max_len); ...serialize into buf...; ring.commit(len);
+// consumer:  auto rec = ring.peek(); if (rec) { ...read rec...; ring.release(); }
+//
+// Each record is an 8 byte header followed by the payload, padded to 8 bytes.
+// A record never wraps: if it does not fit before the end of the buffer the
+// producer leaves a padding marker there and writes the record at offset 0.
+template <size_t capacity = (1 << 20)>
+class SpscRing
+{
+    static_assert(capacity >= 64 && (capacity & (capacity - 1)) == 0, "capacity must be a power of two");
+
+public:
+    class span
+    {
+    public:
+        span() = default;
+        span(uint8_t *data, size_t size) : m_data(data), m_size(size) {}
+
+        uint8_t *data() const { return m_data; }
+        size_t size() const { return m_size; }
+        bool empty() const { return m_size == 0; }
+        uint8_t *begin() const { return m_data; }
+        uint8_t *end() const { return m_data + m_size; }
+        explicit operator bool() const { return m_data != nullptr; }
+
+    private:
+        uint8_t *m_data = nullptr;
+        size_t m_size = 0;
+    };
+
+    SpscRing()
+    {
+        m_buffer.resize(capacity);
+    }
+
+    SpscRing(const SpscRing &_) = delete;
+    SpscRing &operator=(const SpscRing &_) = delete;
+
+    // largest payload that is guaranteed to fit once the ring drains
+    static constexpr size_t max_size()
+    {
+        return capacity / 2 - __header_size;
+    }
+
+    bool empty()
+    {
+        return m_head.load(std::memory_order_acquire) ==
+               m_tail.load(std::memory_order_acquire);
+    }
+
+    // producer: get `size` writable bytes, empty span if there is no room now
+    span reserve(size_t size)
+    {
+        assert(size <= max_size());
+        if (size > max_size())
+        {
+            return span();
+        }
+
+        auto const _tail = m_tail.load(std::memory_order_relaxed);
+        auto const _offset = _tail & __mask;
+        auto const _need = record_size(size);
+        auto const _contiguous = capacity - _offset;
+        auto const _total = _need <= _contiguous ? _need : _contiguous + _need;
+
+        if (_tail + _total - m_head_cache > capacity)
+        {
+            m_head_cache = m_head.load(std::memory_order_acquire);
+            if (_tail + _total - m_head_cache > capacity)
+            {
+                return span();
+            }
+        }
+
+        m_reserved = size;
+        m_wrapped = _need > _contiguous;
+        auto const _record = m_wrapped ? 0 : _offset;
+        return span(&m_buffer[_record + __header_size], size);
+    }
+
+    // producer: publish the first `size` bytes of the last reservation
+    void commit(size_t size)
+    {
+        assert(size <= m_reserved);
+
+        auto _tail = m_tail.load(std::memory_order_relaxed);
+        auto _offset = _tail & __mask;
+        if (m_wrapped)
+        {
+            write_header(_offset, __padding);
+            _tail += capacity - _offset;
+            _offset = 0;
+        }
+
+        write_header(_offset, static_cast<uint32_t>(size));
+        m_reserved = 0;
+        m_wrapped = false;
+        m_tail.store(_tail + record_size(size), std::memory_order_release);
+    }
+
+    // producer: reserve, copy and commit in one call
+    bool try_write(const void *data, size_t size)
+    {
+        auto _span = reserve(size);
+        if (!_span)
+        {
+            return false;
+        }
+        std::memcpy(_span.data(), data, size);
+        commit(size);
+        return true;
+    }
+
+    // consumer: the oldest record, empty span if the ring is empty
+    span peek()
+    {
+        auto _head = m_head.load(std::memory_order_relaxed);
+        if (_head == m_tail_cache)
+        {
+            m_tail_cache = m_tail.load(std::memory_order_acquire);
+            if (_head == m_tail_cache)
+            {
+                return span();
+            }
+        }
+
+        auto _offset = _head & __mask;
+        auto _size = read_header(_offset);
+        if (_size == __padding)
+        {
+            // a padding marker is always committed together with the record after it
+            _head += capacity - _offset;
+            _offset = 0;
+            _size = read_header(_offset);
+        }
+
+        m_peek_head = _head;
+        m_peek_size = _size;
+        return span(&m_buffer[_offset + __header_size], _size);
+    }
+
+    // consumer: drop the record returned by the last peek
+    void release()
+    {
+        m_head.store(m_peek_head + record_size(m_peek_size), std::memory_order_release);
+    }
+
+private:
+#ifdef __cpp_lib_hardware_interference_size
+    static constexpr size_t __chache_line_size =
+        std::hardware_destructive_interference_size;
+#else
+    static constexpr size_t __chache_line_size = 64;
+#endif
+
+    static constexpr size_t __mask = capacity - 1;
+    static constexpr size_t __header_size = 8;
+    static constexpr uint32_t __padding = 0xFFFFFFFF;
+
+    static constexpr size_t record_size(size_t size)
+    {
+        return (__header_size + size + 7) & ~size_t(7);
+    }
+
+    void write_header(size_t offset, uint32_t size)
+    {
+        std::memcpy(&m_buffer[offset], &size, sizeof(size));
+    }
+
+    uint32_t read_header(size_t offset)
+    {
+        uint32_t _size;
+        std::memcpy(&_size, &m_buffer[offset], sizeof(_size));
+        return _size;
+    }
+
+    // positions are byte counters that only grow, offset = position & mask
+    alignas(__chache_line_size) std::vector<uint8_t> m_buffer;
+
+    alignas(__chache_line_size) std::atomic<size_t> m_head{0};
+    size_t m_tail_cache = 0;
+    size_t m_peek_head = 0;
+    uint32_t m_peek_size = 0;
+
+    alignas(__chache_line_size) std::atomic<size_t> m_tail{0};
+    size_t m_head_cache = 0;
+    size_t m_reserved = 0;
+    bool m_wrapped = false;
+};
@@ -0,0 +1,209 @@
+// Stress test for MpscQueue and MpmcQueue, meant to run under ThreadSanitizer.
+//
+//   g++ -std=c++17 -O1 -g -fsanitize=thread -Wno-interference-size stress.cpp -o stress -pthread
+//   stress [producers] [consumers] [items_per_producer]
+//
+// Every producer pushes its own numbered std::string values through a small
+// queue, so the ring wraps and fills over and over. The test checks that
+// every value arrives exactly once and that the values of one producer
+// reach any one consumer in the order they were pushed. Exits with 1 on a
+// failure.
+
+#include "mpmc_queue.hpp"
+#include "mpsc_queue.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <stdint.h>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace
+{
+    struct Options
+    {
+        int producers = 3;
+        int consumers = 2;
+        uint64_t items = 200000;
+    };
+
+    // counts deliveries of every value and the order they come in per consumer
+    class Ledger
+    {
+    public:
+        Ledger(const Options &options)
+            : m_options(options),
+              m_seen(new std::atomic<uint8_t>[size_t(options.producers) * options.items])
+        {
+            for (size_t i = 0; i < size_t(options.producers) * options.items; ++i)
+                m_seen[i].store(0, std::memory_order_relaxed);
+        }
+
+        static std::string make(int producer, uint64_t seq)
+        {
+            // long enough to live on the heap, so a torn or double move shows up
+            return std::to_string(producer) + ":" + std::to_string(seq) + ":payload-payload-payload";
+        }
+
+        // record one delivery, `last` is the consumer's last seq per producer
+        bool take(const std::string &value, std::vector<int64_t> &last)
+        {
+            char *_end = nullptr;
+            auto _producer = std::strtol(value.c_str(), &_end, 10);
+            auto _seq = std::strtoull(_end + 1, nullptr, 10);
+            if (_producer < 0 || _producer >= m_options.producers || _seq >= m_options.items || value != make(int(_producer), _seq))
+            {
+                std::fprintf(stderr, "corrupt value '%s'\n", value.c_str());
+                return false;
+            }
+            if (int64_t(_seq) <= last[size_t(_producer)])
+            {
+                std::fprintf(stderr, "producer %ld: %llu after %lld\n", _producer, (unsigned long long)_seq, (long long)last[size_t(_producer)]);
+                return false;
+            }
+            last[size_t(_producer)] = int64_t(_seq);
+            m_seen[size_t(_producer) * m_options.items + _seq].fetch_add(1, std::memory_order_relaxed);
+            m_taken.fetch_add(1, std::memory_order_relaxed);
+            return true;
+        }
+
+        bool done() const
+        {
+            return m_taken.load(std::memory_order_relaxed) == uint64_t(m_options.producers) * m_options.items;
+        }
+
+        bool exactly_once() const
+        {
+            for (size_t i = 0; i < size_t(m_options.producers) * m_options.items; ++i)
+            {
+                if (m_seen[i].load(std::memory_order_relaxed) != 1)
+                {
+                    std::fprintf(stderr, "producer %zu value %zu arrived %d times\n",
+                                 i / m_options.items, i % m_options.items, int(m_seen[i].load()));
+                    return false;
+                }
+            }
+            return true;
+        }
+
+    private:
+        const Options &m_options;
+        std::unique_ptr<std::atomic<uint8_t>[]> m_seen;
+        std::atomic<uint64_t> m_taken{0};
+    };
+
+    // producers give up once `stop` is set, a failed consumer stops draining
+    // and a blocked push would never return
+    template <typename Queue>
+    std::vector<std::thread> start_producers(Queue &queue, const Options &options, const std::atomic<bool> &stop)
+    {
+        std::vector<std::thread> _threads;
+        for (int p = 0; p < options.producers; ++p)
+        {
+            _threads.emplace_back([&queue, &options, &stop, p]
+                                  {
+                for (uint64_t i = 0; i < options.items && !stop.load(std::memory_order_relaxed); ++i)
+                {
+                    // mix the non-blocking and the timed blocking paths
+                    auto _value = Ledger::make(p, i);
+                    if (i % 3 == 0)
+                    {
+                        while (!queue.try_push(std::move(_value)) && !stop.load(std::memory_order_relaxed))
+                            std::this_thread::yield();
+                    }
+                    else
+                    {
+                        while (!queue.push_for(std::move(_value), std::chrono::milliseconds(10)) && !stop.load(std::memory_order_relaxed))
+                        {
+                        }
+                    }
+                } });
+        }
+        return _threads;
+    }
+
+    bool mpsc(const Options &options)
+    {
+        MpscQueue<std::string, 64, YieldWait<>> _queue;
+        Ledger _ledger(options);
+        std::atomic<bool> _failed{false};
+        auto _producers = start_producers(_queue, options, _failed);
+
+        bool _ok = true;
+        std::vector<int64_t> _last(size_t(options.producers), -1);
+        std::string _value;
+        while (_ok && !_ledger.done())
+        {
+            if (auto _head = _queue.head())
+            {
+                // peek in place when a value is there, otherwise wait for one
+                _ok = _ledger.take(*_head, _last);
+                _queue.pop();
+            }
+            else if (_queue.pop_for(_value, std::chrono::milliseconds(10)))
+            {
+                _ok = _ledger.take(_value, _last);
+            }
+        }
+
+        _failed.store(!_ok, std::memory_order_relaxed);
+        for (auto &_thread : _producers)
+            _thread.join();
+        return _ok && _queue.empty() && _ledger.exactly_once();
+    }
+
+    bool mpmc(const Options &options)
+    {
+        MpmcQueue<std::string, 64, YieldWait<>> _queue;
+        Ledger _ledger(options);
+        std::atomic<bool> _failed{false};
+
+        std::vector<std::thread> _consumers;
+        for (int c = 0; c < options.consumers; ++c)
+        {
+            _consumers.emplace_back([&]
+                                    {
+                std::vector<int64_t> _last(size_t(options.producers), -1);
+                std::string _value;
+                while (!_failed.load(std::memory_order_relaxed) && !_ledger.done())
+                {
+                    if (_queue.pop_for(_value, std::chrono::milliseconds(10)) && !_ledger.take(_value, _last))
+                        _failed.store(true, std::memory_order_relaxed);
+                } });
+        }
+
+        auto _producers = start_producers(_queue, options, _failed);
+        for (auto &_thread : _producers)
+            _thread.join();
+        for (auto &_thread : _consumers)
+            _thread.join();
+        return !_failed.load() && _queue.empty() && _ledger.exactly_once();
+    }
+}
+
+int main(int argc, char **argv)
+{
+    Options _options;
+    if (argc > 1)
+        _options.producers = std::max(1, std::atoi(argv[1]));
+    if (argc > 2)
+        _options.consumers = std::max(1, std::atoi(argv[2]));
+    if (argc > 3)
+        _options.items = std::strtoull(argv[3], nullptr, 10);
+
+    std::printf("%d producers, %d consumers, %llu items each\n",
+                _options.producers, _options.consumers, (unsigned long long)_options.items);
+
+    bool _ok = mpsc(_options);
+    std::printf("mpsc: %s\n", _ok ? "ok" : "FAILED");
+    if (_ok)
+    {
+        _ok = mpmc(_options);
+        std::printf("mpmc: %s\n", _ok ? "ok" : "FAILED");
+    }
+    return _ok ? 0 : 1;
+}
@@ -0,0 +1,191 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <stdint.h>
+#include <thread>
+
+#if defined(_WIN32)
+#define WIN32_LEAN_AND_MEAN
+#include <Windows.h>
+#pragma comment(lib, "Synchronization.lib")
+#elif defined(__linux__)
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
+
+// A wait policy decides what a queue side does while it cannot make progress.
+// `wait(ready, deadline)` returns true once `ready()` holds, false if the deadline passed first.
+// `notify()` is called by the other side after every publish.
+
+namespace spsc_detail
+{
+    using clock = std::chrono::steady_clock;
+
+    constexpr clock::time_point forever = clock::time_point::max();
+
+    inline void cpu_relax()
+    {
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+        _mm_pause();
+#elif defined(__aarch64__) || defined(__arm__)
+        __asm__ __volatile__("yield");
+#endif
+    }
+
+    // sleep while `word` equals `old`, may wake spuriously
+    inline void futex_wait(std::atomic<uint32_t> &word, uint32_t old, clock::time_point deadline)
+    {
+        static_assert(sizeof(std::atomic<uint32_t>) == sizeof(uint32_t), "futex word must be 32 bits");
+
+        auto _now = clock::now();
+        if (deadline <= _now)
+            return;
+        auto _left = std::chrono::duration_cast<std::chrono::nanoseconds>(deadline - _now);
+
+#if defined(_WIN32)
+        DWORD _ms = INFINITE;
+        if (deadline != forever)
+            _ms = static_cast<DWORD>(std::chrono::duration_cast<std::chrono::milliseconds>(_left).count() + 1);
+        WaitOnAddress(reinterpret_cast<volatile VOID *>(&word), &old, sizeof(old), _ms);
+#elif defined(__linux__)
+        struct timespec _ts;
+        struct timespec *_timeout = nullptr;
+        if (deadline != forever)
+        {
+            _ts.tv_sec = static_cast<time_t>(_left.count() / 1000000000);
+            _ts.tv_nsec = static_cast<long>(_left.count() % 1000000000);
+            _timeout = &_ts;
+        }
+        syscall(SYS_futex, reinterpret_cast<uint32_t *>(&word), FUTEX_WAIT_PRIVATE, old, _timeout, nullptr, 0);
+#else
+        if (word.load(std::memory_order_acquire) == old)
+            std::this_thread::sleep_for(std::min<clock::duration>(_left, std::chrono::microseconds(50)));
+#endif
+    }
+
+    inline void futex_wake_all(std::atomic<uint32_t> &word)
+    {
+#if defined(_WIN32)
+        WakeByAddressAll(reinterpret_cast<PVOID>(&word));
+#elif defined(__linux__)
+        syscall(SYS_futex, reinterpret_cast<uint32_t *>(&word), FUTEX_WAKE_PRIVATE, INT32_MAX, nullptr, nullptr, 0);
+#else
+        (void)word;
+#endif
+    }
+}
+
+// busy spin, lowest latency, burns a core while waiting
+class SpinWait
+{
+public:
+    template <typename Ready>
+    bool wait(Ready &&ready, spsc_detail::clock::time_point deadline)
+    {
+        if (deadline == spsc_detail::forever)
+        {
+            while (!ready())
+                spsc_detail::cpu_relax();
+            return true;
+        }
+
+        for (uint32_t _i = 1; !ready(); ++_i)
+        {
+            spsc_detail::cpu_relax();
+            // reading the clock costs more than a pause, only do it now and then
+            if ((_i & 1023) == 0 && spsc_detail::clock::now() >= deadline)
+                return ready();
+        }
+        return true;
+    }
+
+    void notify() {}
+};
+
+// spin for a while, then give the core away to other threads between polls
+template <uint32_t spins = 256>
+class YieldWait
+{
+public:
+    template <typename Ready>
+    bool wait(Ready &&ready, spsc_detail::clock::time_point deadline)
+    {
+        for (uint32_t _i = 0; _i < spins; ++_i)
+        {
+            if (ready())
+                return true;
+            spsc_detail::cpu_relax();
+        }
+
+        while (!ready())
+        {
+            if (deadline != spsc_detail::forever && spsc_detail::clock::now() >= deadline)
+                return ready();
+            std::this_thread::yield();
+        }
+        return true;
+    }
+
+    void notify() {}
+};
+
+// spin for a while, then sleep in the kernel until the other side notifies
+template <uint32_t spins = 256>
+class ParkWait
+{
+public:
+    template <typename Ready>
+    bool wait(Ready &&ready, spsc_detail::clock::time_point deadline)
+    {
+        for (uint32_t _i = 0; _i < spins; ++_i)
+        {
+            if (ready())
+                return true;
+            spsc_detail::cpu_relax();
+        }
+
+        for (;;)
+        {
+            auto const _epoch = m_epoch.load(std::memory_order_acquire);
+
+            // pairs with the fence in notify(): either the notifier sees us
+            // sleeping, or we see what it published
+            m_sleepers.fetch_add(1, std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+
+            if (ready())
+            {
+                m_sleepers.fetch_sub(1, std::memory_order_relaxed);
+                return true;
+            }
+
+            spsc_detail::futex_wait(m_epoch, _epoch, deadline);
+            m_sleepers.fetch_sub(1, std::memory_order_relaxed);
+
+            if (ready())
+                return true;
+            if (deadline != spsc_detail::forever && spsc_detail::clock::now() >= deadline)
+                return false;
+        }
+    }
+
+    void notify()
+    {
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (m_sleepers.load(std::memory_order_relaxed) == 0)
+            return;
+        m_epoch.fetch_add(1, std::memory_order_release);
+        spsc_detail::futex_wake_all(m_epoch);
+    }
+
+private:
+    std::atomic<uint32_t> m_epoch{0};
+    std::atomic<uint32_t> m_sleepers{0};
+};
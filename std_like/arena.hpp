@@ -0,0 +1,163 @@
+#pragma once
+
+#include <algorithm>
+#include <cassert>
+#include <cstddef>
+#include <memory>
+#include <new>
+#include <stdint.h>
+
+// Monotonic arena: allocate() bumps a pointer through the current block and
+// deallocate() does nothing, memory only comes back all at once through
+// reset() or the destructor. Made for per-request scratch data, e.g.
+//
+//   arena request_arena;
+//   basic_string_t<arena_allocator<char>> name("...", request_arena);
+//   ...
+//   request_arena.reset(); // every string of the request is gone
+//
+// Objects living in the arena must not need their destructors run, or must
+// be destroyed before reset(). Not thread safe, use one arena per thread
+// or per request.
+
+class arena {
+    // header in front of every heap block, the usable bytes follow it
+    struct block_t {
+        block_t *next;
+        size_t size;
+    };
+
+    static constexpr size_t header_size =
+        (sizeof(block_t) + alignof(std::max_align_t) - 1) & ~(alignof(std::max_align_t) - 1);
+
+    char *_cursor = nullptr;
+    char *_end = nullptr;
+    block_t *_blocks = nullptr; // newest first, the oldest block is kept by reset()
+    size_t _block_size;
+    size_t _next_block_size;
+
+    static char *block_data(block_t *block) noexcept {
+        return reinterpret_cast<char *>(block) + header_size;
+    }
+
+    static char *align_up(char *ptr, size_t align) noexcept {
+        auto address = reinterpret_cast<uintptr_t>(ptr);
+        return reinterpret_cast<char *>((address + align - 1) & ~static_cast<uintptr_t>(align - 1));
+    }
+
+    // slow path: the current block is full, chain a new one at least twice as big
+    void *allocate_block(size_t size, size_t align) {
+        if (size > static_cast<size_t>(-1) / 2 - header_size - align)
+            throw std::bad_alloc();
+
+        auto usable = std::max(_next_block_size, size + align);
+        auto block = static_cast<block_t *>(::operator new(header_size + usable));
+        block->next = _blocks;
+        block->size = usable;
+        _blocks = block;
+        _next_block_size = std::max(_next_block_size, usable) * 2;
+
+        _cursor = block_data(block);
+        _end = _cursor + usable;
+        return allocate(size, align);
+    }
+
+    void free_blocks(block_t *until) noexcept {
+        while (_blocks != until) {
+            auto next = _blocks->next;
+            ::operator delete(_blocks);
+            _blocks = next;
+        }
+    }
+
+public:
+    // the first block is allocated lazily, `block_size` bytes
+    explicit arena(size_t block_size = 64 * 1024) noexcept
+        : _block_size(std::max<size_t>(block_size, 64)), _next_block_size(_block_size) {}
+
+    arena(const arena &) = delete;
+    arena &operator=(const arena &) = delete;
+
+    ~arena() {
+        free_blocks(nullptr);
+    }
+
+    void *allocate(size_t size, size_t align = alignof(std::max_align_t)) {
+        assert(align != 0 && (align & (align - 1)) == 0);
+        auto ptr = align_up(_cursor, align);
+        if (_cursor != nullptr && ptr <= _end && size <= static_cast<size_t>(_end - ptr)) {
+            _cursor = ptr + size;
+            return ptr;
+        }
+        return allocate_block(size, align);
+    }
+
+    void deallocate(void *, size_t) noexcept {}
+
+    // drops every allocation; the oldest block stays for reuse, so a request
+    // that fits in it costs no heap traffic at all
+    void reset() noexcept {
+        if (_blocks == nullptr)
+            return;
+
+        auto oldest = _blocks;
+        while (oldest->next != nullptr)
+            oldest = oldest->next;
+
+        auto rest = _blocks;
+        _blocks = oldest;
+        while (rest != oldest) {
+            auto next = rest->next;
+            ::operator delete(rest);
+            rest = next;
+        }
+
+        _cursor = block_data(oldest);
+        _end = _cursor + oldest->size;
+        _next_block_size = std::max(_block_size, oldest->size * 2);
+    }
+
+    // release everything, including the block reset() would keep
+    void release() noexcept {
+        free_blocks(nullptr);
+        _cursor = _end = nullptr;
+        _next_block_size = _block_size;
+    }
+};
+
+// std allocator adapter, so containers and basic_string_t can draw from an arena
+template <typename T>
+class arena_allocator {
+    template <typename U>
+    friend class arena_allocator;
+
+    arena *_arena;
+
+public:
+    using value_type = T;
+
+    arena_allocator(arena &source) noexcept : _arena(&source) {}
+
+    template <typename U>
+    arena_allocator(const arena_allocator<U> &other) noexcept : _arena(other._arena) {}
+
+    T *allocate(size_t count) {
+        if (count > static_cast<size_t>(-1) / sizeof(T))
+            throw std::bad_alloc();
+        return static_cast<T *>(_arena->allocate(count * sizeof(T), alignof(T)));
+    }
+
+    void deallocate(T *, size_t) noexcept {}
+
+    arena &resource() const noexcept { return *_arena; }
+
+    template <typename U>
+    friend bool operator==(const arena_allocator &a, const arena_allocator<U> &b) noexcept {
+        return a._arena == b._arena;
+    }
+
+    template <typename U>
+    friend bool operator!=(const arena_allocator &a, const arena_allocator<U> &b) noexcept {
+        return a._arena != b._arena;
+    }
+};
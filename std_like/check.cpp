@@ -0,0 +1,113 @@
+// Regression checks for string_t and string_ref, run them under the sanitizers:
+//
+//   g++ -std=c++17 -g -fsanitize=address,undefined check.cpp -o check && ./check
+//
+// Prints the failed checks and exits with 1 if there are any.
+
+#include "arena.hpp"
+#include "string.hpp"
+#include "string_ref.hpp"
+
+#include <cstdio>
+#include <cstring>
+#include <memory_resource>
+#include <string>
+
+namespace {
+    int failures = 0;
+
+    void check(bool ok, const char *what, int line) {
+        if (!ok) {
+            std::fprintf(stderr, "line %d: %s\n", line, what);
+            ++failures;
+        }
+    }
+
+#define CHECK(expr) check((expr), #expr, __LINE__)
+
+    bool equals(const string_t &s, const char *expected) {
+        return s.size() == std::strlen(expected) && std::memcmp(s.data(), expected, s.size()) == 0 && s.data()[s.size()] == '\0';
+    }
+
+    // the expression reads from the string it is appended to while the append grows it
+    void self_append() {
+        string_t small("abc");
+        small += small + small; // inline buffer to heap
+        CHECK(equals(small, "abcabcabc"));
+
+        string_t t("0123456789012345678901234567890");
+        auto expected = std::string(t.data(), t.size());
+        expected += expected + expected;
+        t += t + t; // heap buffer to a bigger one
+        CHECK(equals(t, expected.c_str()));
+
+        t += "-" + t + "-";
+        expected += "-" + expected + "-";
+        CHECK(equals(t, expected.c_str()));
+
+        // without growth the pieces stay valid too
+        string_t roomy("xy");
+        roomy.reserve(64);
+        roomy += roomy + roomy;
+        CHECK(equals(roomy, "xyxyxy"));
+    }
+
+    // copy and move assignment have to compile for allocators that do not propagate,
+    // and keep each string's own allocator
+    template <typename String, typename Alloc>
+    void assign_between(const Alloc &first, const Alloc &second) {
+        String a("first", first);
+        String b("a string too long for the inline buffer", second);
+        a = b;
+        CHECK(a.size() == b.size() && std::memcmp(a.data(), b.data(), a.size()) == 0);
+        CHECK(a.get_allocator() == first);
+        a = std::move(b);
+        CHECK(a.size() == 39 && std::memcmp(a.data(), "a string too long for the inline buffer", 39) == 0);
+        CHECK(a.get_allocator() == first);
+
+        String c("same", first);
+        a = std::move(c);
+        CHECK(a.size() == 4 && std::memcmp(a.data(), "same", 4) == 0);
+    }
+
+    void assignment() {
+        std::pmr::monotonic_buffer_resource first_resource, second_resource;
+        assign_between<basic_string_t<std::pmr::polymorphic_allocator<char>>>(
+            std::pmr::polymorphic_allocator<char>(&first_resource), std::pmr::polymorphic_allocator<char>(&second_resource));
+
+        arena first_arena, second_arena;
+        assign_between<basic_string_t<arena_allocator<char>>>(
+            arena_allocator<char>(first_arena), arena_allocator<char>(second_arena));
+    }
+
+    // an empty separator does not split, not even on embedded '\0' bytes
+    void split_empty_separator() {
+        const char text[] = {'a', '\0', 'b'};
+        int pieces = 0;
+        for (auto piece : string_ref(text, sizeof(text)).split(string_ref())) {
+            CHECK(piece.size() == sizeof(text) && piece.data() == text);
+            ++pieces;
+        }
+        CHECK(pieces == 1);
+
+        pieces = 0;
+        for (auto piece : string_ref("").split(string_ref(""))) {
+            CHECK(piece.empty());
+            ++pieces;
+        }
+        CHECK(pieces == 1);
+    }
+}
+
+int main() {
+    self_append();
+    assignment();
+    split_empty_separator();
+
+    if (failures != 0) {
+        std::fprintf(stderr, "%d checks failed\n", failures);
+        return 1;
+    }
+    std::printf("ok\n");
+    return 0;
+}
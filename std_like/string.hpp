@@ -2,117 +2,412 @@
 
 #include <algorithm>
 #include <cassert>
+#include <cstring>
+#include <memory>
 #include <stdint.h>
+#include <type_traits>
+#include <utility>
 
-class string_t {
+// basic_string_t keeps short strings inside the object itself (small string
+// optimization, same idea as libc++): 24 bytes hold either
+//
+//   short: [size << 1][22 chars + '\0']
+//   long:  [capacity | flag][size][pointer to heap buffer]
+//
+// The first byte tells them apart. In long mode it is the low byte of the
+// capacity word on little endian (capacity is kept even, the flag is bit 0)
+// and the high byte on big endian (the flag is the top bit).
+//
+// `a + b + "c" + d` does not build intermediate strings: operator+ returns a
+// light concat_t expression of pointer/length pieces, and converting it to
+// string_t sizes the result once and copies every piece straight in. The
+// expression points into its operands, so turn it into a string_t within
+// the same statement rather than keeping it in an `auto` variable.
+//
+// Heap buffers come from `Alloc` (std::allocator by default, which the
+// empty base optimization keeps out of the 24 bytes). Pass an
+// arena_allocator from arena.hpp, or std::pmr::polymorphic_allocator<char>,
+// to take per-request strings from a bump allocator and drop them all at once.
+
+template <typename Alloc>
+class basic_string_t;
+
+namespace string_detail {
+    struct piece_t {
+        const char *data;
+        size_t size;
+
+        size_t length() const noexcept { return size; }
+        void copy_to(char *out) const noexcept { std::memcpy(out, data, size); }
+    };
+
+    template <typename L, typename R>
+    struct concat_t {
+        L left;
+        R right;
+        size_t size;
+
+        concat_t(const L &l, const R &r) : left(l), right(r), size(l.length() + r.length()) {}
+
+        size_t length() const noexcept { return size; }
+
+        void copy_to(char *out) const noexcept {
+            left.copy_to(out);
+            right.copy_to(out + left.length());
+        }
+    };
+
+    template <typename T>
+    struct is_concat : std::false_type {};
+
+    template <typename L, typename R>
+    struct is_concat<concat_t<L, R>> : std::true_type {};
+
+    template <typename T>
+    struct is_string : std::false_type {};
+
+    template <typename Alloc>
+    struct is_string<basic_string_t<Alloc>> : std::true_type {};
+}
+
+template <typename Alloc = std::allocator<char>>
+class basic_string_t : private std::allocator_traits<Alloc>::template rebind_alloc<char> {
 public:
-    static const size_t capacity_min;
+    using allocator_type = typename std::allocator_traits<Alloc>::template rebind_alloc<char>;
+
+
+    // buffer bytes available without touching the heap, '\0' included
+    static constexpr size_t capacity_min = 23;
 
 private:
-    size_t _size = 0;
-    size_t _capacity = 16;
-    char *_data = new char[16];
+    using alloc_traits = std::allocator_traits<allocator_type>;
+
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    static constexpr size_t long_flag = size_t(1) << (sizeof(size_t) * 8 - 1);
+    static constexpr uint8_t long_flag_byte = 0x80;
+#else
+    static constexpr size_t long_flag = 1;
+    static constexpr uint8_t long_flag_byte = 0x01;
+#endif
+
+    struct long_t {
+        size_t capacity;
+        size_t size;
+        char *data;
+    };
+
+    static constexpr size_t short_size_max = sizeof(long_t) - 2;
+
+    struct short_t {
+        uint8_t size;
+        char data[sizeof(long_t) - 1];
+    };
+
+    static_assert(sizeof(short_t) == sizeof(long_t), "short and long layout must overlap exactly");
+    static_assert(short_size_max + 1 == capacity_min, "capacity_min must match the inline buffer");
+
+    union {
+        long_t _long;
+        short_t _short;
+    };
 
 private:
-    void realloc(size_t size) {
-        _size = size;
+    allocator_type &alloc() noexcept { return *this; }
+    const allocator_type &alloc() const noexcept { return *this; }
 
-        if (size <= _capacity - 1) {
-            return;
+    bool is_long() const noexcept {
+        return (_short.size & long_flag_byte) != 0;
+    }
+
+    char *ptr() noexcept {
+        return is_long() ? _long.data : _short.data;
+    }
+
+    const char *ptr() const noexcept {
+        return is_long() ? _long.data : _short.data;
+    }
+
+    void set_size(size_t size) noexcept {
+        if (is_long()) {
+            _long.size = size;
+        } else {
+            _short.size = static_cast<uint8_t>(size << 1);
+        }
+        ptr()[size] = '\0';
+    }
+
+    void init_short() noexcept {
+        std::memset(&_long, 0, sizeof(_long));
+    }
+
+    void release() noexcept {
+        if (is_long()) {
+            alloc_traits::deallocate(alloc(), _long.data, capacity());
         }
+    }
+
+    // take over `other`'s buffer, leaving it empty
+    void steal(basic_string_t &other) noexcept {
+        std::memcpy(&_long, &other._long, sizeof(_long));
+        other.init_short();
+    }
+
+    // heap capacities are multiples of 4, which also keeps the little endian flag bit free
+    static constexpr size_t round_capacity(size_t bytes) noexcept {
+        return (bytes + 3) & ~size_t(3);
+    }
+
+    // move the contents into a heap buffer of exactly `next_capacity` bytes.
+    // `fill(next_data)` runs before the old buffer is freed, so it may still read from it.
+    template <typename Fill>
+    void grow_to(size_t next_capacity, Fill &&fill) {
+        auto next_data = alloc_traits::allocate(alloc(), next_capacity);
+        auto old_size = this->size();
+        std::memcpy(next_data, ptr(), old_size);
+        next_data[old_size] = '\0';
+        fill(next_data);
+        release();
+
+        _long.data = next_data;
+        _long.capacity = next_capacity | long_flag;
+        _long.size = old_size;
+    }
+
+    void grow_to(size_t next_capacity) {
+        grow_to(next_capacity, [](char *) {});
+    }
 
-        auto next_capacity = std::max(16ULL, size + 4 - (size + 4) % 4);
-        auto next_data = new char[_capacity];
-        std::memset(next_data, '\0', next_capacity);
-        if (_data && _size) {
-            std::memcpy(next_data, _data, _size);
-            delete _data;
+    // make room for `size` chars plus '\0', keeping the current contents.
+    // Capacity at least doubles, so n appends copy O(n) bytes in total.
+    void realloc(size_t size) {
+        if (size + 1 > capacity()) {
+            grow_to(round_capacity(std::max(size + 1, capacity() * 2)));
         }
-        _data = next_data;
-        _capacity = next_capacity;
+        set_size(size);
     }
 
     void assign(const char *data, size_t size) {
         realloc(size);
-        std::memset(_data, '\0', _capacity);
-        std::memcpy(_data, data, size);
+        std::memmove(ptr(), data, size);
     }
 
 public:
-    string_t() {
-        assign("", 0);
+    basic_string_t() noexcept(noexcept(allocator_type())) : allocator_type() {
+        init_short();
     };
 
-    string_t(const char *str) {
+    explicit basic_string_t(const allocator_type &alloc) noexcept : allocator_type(alloc) {
+        init_short();
+    }
+
+    basic_string_t(const char *str, const allocator_type &alloc = allocator_type()) : allocator_type(alloc) {
         assert(str != nullptr);
-        auto size = std::strlen(str);
-        assign(str, size);
+        init_short();
+        assign(str, std::strlen(str));
     }
 
-    string_t(const char *data, size_t size) {
+    basic_string_t(const char *data, size_t size, const allocator_type &alloc = allocator_type()) : allocator_type(alloc) {
         assert(data != nullptr);
+        init_short();
         assign(data, size);
     }
 
-    string_t(const string_t &other) {
-        if (&other == this)
-            return;
-        assign(other._data, other._size);
+    basic_string_t(const basic_string_t &other)
+        : allocator_type(alloc_traits::select_on_container_copy_construction(other.alloc())) {
+        init_short();
+        assign(other.data(), other.size());
+    }
+
+    basic_string_t(const basic_string_t &other, const allocator_type &alloc) : allocator_type(alloc) {
+        init_short();
+        assign(other.data(), other.size());
+    }
+
+    template <typename L, typename R>
+    basic_string_t(const string_detail::concat_t<L, R> &expr, const allocator_type &alloc = allocator_type())
+        : allocator_type(alloc) {
+        init_short();
+        append(expr);
+    }
+
+    basic_string_t(basic_string_t &&other) noexcept : allocator_type(std::move(other.alloc())) {
+        steal(other);
     }
 
-    string_t(string_t &&other) noexcept
-        : _data(other._data),
-          _size(other._size),
-          _capacity(other._capacity) {
-        other._data = nullptr;
-        other._size = 0;
-        other._capacity = 0;
+    ~basic_string_t() {
+        release();
     }
 
-    void operator=(const string_t &other) {
+    basic_string_t &operator=(const basic_string_t &other) {
         if (&other == this)
-            return;
-        assign(other._data, other._size);
+            return *this;
+        // constexpr: allocators that do not propagate, like pmr's, need not be assignable
+        if constexpr (alloc_traits::propagate_on_container_copy_assignment::value) {
+            if (alloc() != other.alloc()) {
+                release();
+                init_short();
+                alloc() = other.alloc();
+            }
+        }
+        realloc(0);
+        assign(other.data(), other.size());
+        return *this;
+    }
+
+    basic_string_t &operator=(basic_string_t &&other) noexcept(
+        alloc_traits::propagate_on_container_move_assignment::value || alloc_traits::is_always_equal::value) {
+        if (&other == this)
+            return *this;
+        if constexpr (alloc_traits::propagate_on_container_move_assignment::value) {
+            release();
+            alloc() = std::move(other.alloc());
+            steal(other);
+        } else if (alloc() == other.alloc()) {
+            release();
+            steal(other);
+        } else {
+            // the buffer belongs to another arena, it has to be copied
+            realloc(0);
+            assign(other.data(), other.size());
+        }
+        return *this;
     }
 
-    string_t &append(const char *str, size_t size) {
+    allocator_type get_allocator() const noexcept { return alloc(); }
+
+
+    basic_string_t &append(const char *str, size_t size) {
         assert(str != nullptr);
-        auto append_at = _size;
-        realloc(size + _size);
-        std::memcpy(_data + append_at, str, size);
+        auto append_at = this->size();
+        // `str` may point into our own buffer, which realloc can free
+        auto inside = str >= ptr() && str < ptr() + append_at;
+        auto offset = inside ? static_cast<size_t>(str - ptr()) : 0;
+        realloc(size + append_at);
+        std::memmove(ptr() + append_at, inside ? ptr() + offset : str, size);
+        return *this;
     }
 
-    string_t &append(const char *str) {
+    basic_string_t &append(const char *str) {
         assert(str != nullptr);
         return append(str, std::strlen(str));
     }
 
-    void operator=(string_t &&other) {
-        _data = other._data;
-        _size = other._size;
-        _capacity = other._capacity;
-        other._data = nullptr;
-        other._size = 0;
-        other._capacity = 0;
+    template <typename OtherAlloc>
+    basic_string_t &append(const basic_string_t<OtherAlloc> &other) {
+        return append(other.data(), other.size());
+    }
+
+    // one size check, at most one allocation, then every piece is copied in place
+    template <typename L, typename R>
+    basic_string_t &append(const string_detail::concat_t<L, R> &expr) {
+        auto append_at = size();
+        auto length = expr.length();
+        if (append_at + length + 1 > capacity()) {
+            // the pieces may point into our own buffer (`s += s + s`), so they
+            // are copied into the new one before the old one is freed
+            grow_to(round_capacity(std::max(append_at + length, capacity() * 2) + 1),
+                    [&](char *next_data) { expr.copy_to(next_data + append_at); });
+        } else {
+            expr.copy_to(ptr() + append_at);
+        }
+        set_size(append_at + length);
+        return *this;
+    }
+
+    template <typename OtherAlloc>
+    basic_string_t &operator+=(const basic_string_t<OtherAlloc> &other) { return append(other); }
+    basic_string_t &operator+=(const char *str) { return append(str); }
+
+    template <typename L, typename R>
+    basic_string_t &operator+=(const string_detail::concat_t<L, R> &expr) { return append(expr); }
+
+    // make room for `size` chars without changing the contents
+    void reserve(size_t size) {
+        if (size + 1 > capacity()) {
+            grow_to(round_capacity(size + 1));
+        }
     }
 
-    void clear() {
-        _size = 0;
-        if (_data) {
-            delete _data;
+    // give back unused heap memory, moving back inline when the contents fit
+    void shrink_to_fit() {
+        if (!is_long()) {
+            return;
+        }
+
+        auto old_size = _long.size;
+        auto old_data = _long.data;
+        auto old_capacity = capacity();
+        if (old_size <= short_size_max) {
+            _short.size = static_cast<uint8_t>(old_size << 1);
+            std::memcpy(_short.data, old_data, old_size);
+            _short.data[old_size] = '\0';
+            alloc_traits::deallocate(alloc(), old_data, old_capacity);
+        } else if (round_capacity(old_size + 1) < capacity()) {
+            grow_to(round_capacity(old_size + 1));
         }
-        _data = nullptr;
+    }
+
+    // drops the contents but keeps the buffer for reuse
+    void clear() noexcept {
+        set_size(0);
     }
 
     char &operator[](size_t index) {
-        return _data[index];
+        return ptr()[index];
     }
 
-    const char *c_str() const noexcept { return _data; }
-    const char *data() const noexcept { return _data; }
-    size_t size() const noexcept { return _size; }
-    size_t capacity() const noexcept { return _capacity; }
-    bool empty() const noexcept { return _size == 0; }
+    const char &operator[](size_t index) const {
+        return ptr()[index];
+    }
+
+    const char *c_str() const noexcept { return ptr(); }
+    const char *data() const noexcept { return ptr(); }
+    size_t size() const noexcept { return is_long() ? _long.size : (_short.size >> 1); }
+    size_t capacity() const noexcept { return is_long() ? (_long.capacity & ~long_flag) : capacity_min; }
+    bool empty() const noexcept { return size() == 0; }
 };
 
-const size_t string_t::capacity_min = 16;
\ No newline at end of file
+using string_t = basic_string_t<>;
+
+static_assert(sizeof(string_t) == 3 * sizeof(size_t), "the default allocator must not grow string_t");
+
+namespace string_detail {
+    template <typename Alloc>
+    piece_t as_expr(const basic_string_t<Alloc> &str) noexcept {
+        return piece_t{str.data(), str.size()};
+    }
+
+    inline piece_t as_expr(const char *str) noexcept {
+        assert(str != nullptr);
+        return piece_t{str, std::strlen(str)};
+    }
+
+    template <typename L, typename R>
+    const concat_t<L, R> &as_expr(const concat_t<L, R> &expr) noexcept {
+        return expr;
+    }
+
+    template <typename T>
+    using operand_t = typename std::decay<T>::type;
+
+    template <typename T>
+    constexpr bool is_string_or_expr =
+        is_string<operand_t<T>>::value || is_concat<operand_t<T>>::value;
+
+    template <typename T>
+    constexpr bool is_operand =
+        is_string_or_expr<T> ||
+        std::is_same<operand_t<T>, const char *>::value || std::is_same<operand_t<T>, char *>::value;
+
+    template <typename T>
+    using expr_t = typename std::decay<decltype(as_expr(std::declval<const T &>()))>::type;
+}
+
+// string_t / C string / expression, in any mix where at least one side is not a C string
+template <typename L, typename R,
+          typename = typename std::enable_if<string_detail::is_operand<L> && string_detail::is_operand<R> &&
+                                             (string_detail::is_string_or_expr<L> || string_detail::is_string_or_expr<R>)>::type>
+string_detail::concat_t<string_detail::expr_t<L>, string_detail::expr_t<R>> operator+(const L &left, const R &right) {
+    using string_detail::as_expr;
+    return {as_expr(left), as_expr(right)};
+}
@@ -0,0 +1,344 @@
+#pragma once
+
+#include "string.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <cstring>
+#include <stdint.h>
+
+#if defined(__AVX2__) || defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define STRING_REF_SSE2 1
+#include <emmintrin.h>
+#endif
+
+#if defined(__AVX2__)
+#define STRING_REF_AVX2 1
+#include <immintrin.h>
+#endif
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+// string_ref is a non-owning (pointer, size) view over string_t, C strings
+// or any other char buffer. Slicing, searching and splitting only move the
+// pointer and size around, nothing here allocates. The viewed buffer must
+// outlive the view.
+//
+// The hot loops (find a char, find a substring, first mismatch) scan 32
+// bytes per step with AVX2 or 16 with SSE2 and finish the tail one byte at
+// a time; without either they are plain loops.
+
+namespace string_ref_detail {
+    constexpr size_t npos = static_cast<size_t>(-1);
+
+    inline unsigned count_trailing_zeros(uint32_t mask) noexcept {
+#if defined(_MSC_VER)
+        unsigned long index;
+        _BitScanForward(&index, mask);
+        return static_cast<unsigned>(index);
+#else
+        return static_cast<unsigned>(__builtin_ctz(mask));
+#endif
+    }
+
+    inline size_t find_char(const char *data, size_t size, char c) noexcept {
+        size_t i = 0;
+#if defined(STRING_REF_AVX2)
+        auto needle32 = _mm256_set1_epi8(c);
+        for (; i + 32 <= size; i += 32) {
+            auto block = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(data + i));
+            auto mask = static_cast<uint32_t>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(block, needle32)));
+            if (mask != 0)
+                return i + count_trailing_zeros(mask);
+        }
+#endif
+#if defined(STRING_REF_SSE2)
+        auto needle16 = _mm_set1_epi8(c);
+        for (; i + 16 <= size; i += 16) {
+            auto block = _mm_loadu_si128(reinterpret_cast<const __m128i *>(data + i));
+            auto mask = static_cast<uint32_t>(_mm_movemask_epi8(_mm_cmpeq_epi8(block, needle16)));
+            if (mask != 0)
+                return i + count_trailing_zeros(mask);
+        }
+#endif
+        for (; i < size; ++i) {
+            if (data[i] == c)
+                return i;
+        }
+        return npos;
+    }
+
+    // index of the first byte where `a` and `b` differ, or `size` when equal
+    inline size_t mismatch(const char *a, const char *b, size_t size) noexcept {
+        size_t i = 0;
+#if defined(STRING_REF_AVX2)
+        for (; i + 32 <= size; i += 32) {
+            auto block_a = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(a + i));
+            auto block_b = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(b + i));
+            auto mask = ~static_cast<uint32_t>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(block_a, block_b)));
+            if (mask != 0)
+                return i + count_trailing_zeros(mask);
+        }
+#endif
+#if defined(STRING_REF_SSE2)
+        for (; i + 16 <= size; i += 16) {
+            auto block_a = _mm_loadu_si128(reinterpret_cast<const __m128i *>(a + i));
+            auto block_b = _mm_loadu_si128(reinterpret_cast<const __m128i *>(b + i));
+            auto mask = ~static_cast<uint32_t>(_mm_movemask_epi8(_mm_cmpeq_epi8(block_a, block_b))) & 0xFFFFu;
+            if (mask != 0)
+                return i + count_trailing_zeros(mask);
+        }
+#endif
+        for (; i < size; ++i) {
+            if (a[i] != b[i])
+                return i;
+        }
+        return size;
+    }
+
+    // Candidates are positions where both the first and the last needle byte
+    // match, tested a whole block at a time; only those get a full compare.
+    inline size_t find(const char *data, size_t size, const char *needle, size_t length) noexcept {
+        if (length == 0)
+            return 0;
+        if (length > size)
+            return npos;
+        if (length == 1)
+            return find_char(data, size, needle[0]);
+
+        size_t i = 0;
+        auto last = length - 1;
+#if defined(STRING_REF_AVX2)
+        auto first32 = _mm256_set1_epi8(needle[0]);
+        auto last32 = _mm256_set1_epi8(needle[last]);
+        for (; i + last + 32 <= size; i += 32) {
+            auto block_first = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(data + i));
+            auto block_last = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(data + i + last));
+            auto mask = static_cast<uint32_t>(_mm256_movemask_epi8(
+                _mm256_and_si256(_mm256_cmpeq_epi8(block_first, first32), _mm256_cmpeq_epi8(block_last, last32))));
+            while (mask != 0) {
+                auto at = i + count_trailing_zeros(mask);
+                if (std::memcmp(data + at + 1, needle + 1, length - 2) == 0)
+                    return at;
+                mask &= mask - 1;
+            }
+        }
+#endif
+#if defined(STRING_REF_SSE2)
+        auto first16 = _mm_set1_epi8(needle[0]);
+        auto last16 = _mm_set1_epi8(needle[last]);
+        for (; i + last + 16 <= size; i += 16) {
+            auto block_first = _mm_loadu_si128(reinterpret_cast<const __m128i *>(data + i));
+            auto block_last = _mm_loadu_si128(reinterpret_cast<const __m128i *>(data + i + last));
+            auto mask = static_cast<uint32_t>(_mm_movemask_epi8(
+                _mm_and_si128(_mm_cmpeq_epi8(block_first, first16), _mm_cmpeq_epi8(block_last, last16))));
+            while (mask != 0) {
+                auto at = i + count_trailing_zeros(mask);
+                if (std::memcmp(data + at + 1, needle + 1, length - 2) == 0)
+                    return at;
+                mask &= mask - 1;
+            }
+        }
+#endif
+        for (; i + length <= size; ++i) {
+            if (data[i] == needle[0] && data[i + last] == needle[last] &&
+                std::memcmp(data + i + 1, needle + 1, length - 2) == 0)
+                return i;
+        }
+        return npos;
+    }
+}
+
+class string_ref {
+public:
+    static constexpr size_t npos = string_ref_detail::npos;
+
+    class split_iterator;
+    class split_range;
+
+private:
+    const char *_data = nullptr;
+    size_t _size = 0;
+
+public:
+    constexpr string_ref() noexcept = default;
+
+    constexpr string_ref(const char *data, size_t size) noexcept : _data(data), _size(size) {}
+
+    string_ref(const char *str) noexcept : _data(str), _size(std::strlen(str)) {
+        assert(str != nullptr);
+    }
+
+    template <typename Alloc>
+    string_ref(const basic_string_t<Alloc> &str) noexcept : _data(str.data()), _size(str.size()) {}
+
+    const char *data() const noexcept { return _data; }
+    size_t size() const noexcept { return _size; }
+    bool empty() const noexcept { return _size == 0; }
+
+    const char *begin() const noexcept { return _data; }
+    const char *end() const noexcept { return _data + _size; }
+
+    const char &operator[](size_t index) const {
+        assert(index < _size);
+        return _data[index];
+    }
+
+    // owning copy, the one operation here that allocates
+    string_t str() const {
+        return string_t(_data != nullptr ? _data : "", _size);
+    }
+
+    // `pos` and `count` are clamped to the view, like std::string_view without the throw
+    string_ref substr(size_t pos, size_t count = npos) const noexcept {
+        pos = std::min(pos, _size);
+        return string_ref(_data + pos, std::min(count, _size - pos));
+    }
+
+    void remove_prefix(size_t count) noexcept {
+        count = std::min(count, _size);
+        _data += count;
+        _size -= count;
+    }
+
+    void remove_suffix(size_t count) noexcept {
+        _size -= std::min(count, _size);
+    }
+
+    size_t find(char c, size_t pos = 0) const noexcept {
+        if (pos >= _size)
+            return npos;
+        auto at = string_ref_detail::find_char(_data + pos, _size - pos, c);
+        return at == npos ? npos : pos + at;
+    }
+
+    size_t find(string_ref needle, size_t pos = 0) const noexcept {
+        if (pos > _size)
+            return npos;
+        auto at = string_ref_detail::find(_data + pos, _size - pos, needle._data, needle._size);
+        return at == npos ? npos : pos + at;
+    }
+
+    bool contains(char c) const noexcept { return find(c) != npos; }
+    bool contains(string_ref needle) const noexcept { return find(needle) != npos; }
+
+    // <0, 0 or >0, bytes compared as unsigned char like memcmp
+    int compare(string_ref other) const noexcept {
+        auto common = std::min(_size, other._size);
+        auto at = string_ref_detail::mismatch(_data, other._data, common);
+        if (at < common)
+            return static_cast<unsigned char>(_data[at]) < static_cast<unsigned char>(other._data[at]) ? -1 : 1;
+        return _size == other._size ? 0 : (_size < other._size ? -1 : 1);
+    }
+
+    bool starts_with(string_ref prefix) const noexcept {
+        return prefix._size <= _size &&
+               string_ref_detail::mismatch(_data, prefix._data, prefix._size) == prefix._size;
+    }
+
+    bool ends_with(string_ref suffix) const noexcept {
+        return suffix._size <= _size &&
+               string_ref_detail::mismatch(_data + _size - suffix._size, suffix._data, suffix._size) == suffix._size;
+    }
+
+    // pieces between separators; "a,,b" gives "a", "" and "b", an empty view gives one empty piece.
+    // An empty separator does not split, the whole view is the one piece.
+    split_range split(char separator) const noexcept;
+    split_range split(string_ref separator) const noexcept;
+
+    friend bool operator==(string_ref a, string_ref b) noexcept {
+        return a._size == b._size && string_ref_detail::mismatch(a._data, b._data, a._size) == a._size;
+    }
+
+    friend bool operator!=(string_ref a, string_ref b) noexcept { return !(a == b); }
+    friend bool operator<(string_ref a, string_ref b) noexcept { return a.compare(b) < 0; }
+    friend bool operator>(string_ref a, string_ref b) noexcept { return a.compare(b) > 0; }
+    friend bool operator<=(string_ref a, string_ref b) noexcept { return a.compare(b) <= 0; }
+    friend bool operator>=(string_ref a, string_ref b) noexcept { return a.compare(b) >= 0; }
+};
+
+class string_ref::split_iterator {
+    string_ref _rest;
+    string_ref _piece;
+    string_ref _separator;
+    char _separator_char = 0;
+    bool _by_char = false; // split on `_separator_char` rather than `_separator`
+    bool _last = false;
+    bool _done = true;
+
+    friend class string_ref::split_range;
+
+    split_iterator(string_ref text, string_ref separator, char separator_char, bool by_char) noexcept
+        : _rest(text), _separator(separator), _separator_char(separator_char), _by_char(by_char), _done(false) {
+        advance();
+    }
+
+    void advance() noexcept {
+        if (_last) {
+            _done = true;
+            return;
+        }
+
+        // an empty separator matches nowhere, the whole text is one piece
+        auto at = _by_char ? _rest.find(_separator_char) : _separator.empty() ? npos : _rest.find(_separator);
+        if (at == npos) {
+            _piece = _rest;
+            _last = true;
+            return;
+        }
+
+        _piece = _rest.substr(0, at);
+        _rest.remove_prefix(at + (_by_char ? 1 : _separator.size()));
+    }
+
+public:
+    split_iterator() noexcept = default;
+
+    const string_ref &operator*() const noexcept { return _piece; }
+    const string_ref *operator->() const noexcept { return &_piece; }
+
+    split_iterator &operator++() noexcept {
+        advance();
+        return *this;
+    }
+
+    split_iterator operator++(int) noexcept {
+        auto copy = *this;
+        advance();
+        return copy;
+    }
+
+    friend bool operator==(const split_iterator &a, const split_iterator &b) noexcept {
+        if (a._done || b._done)
+            return a._done == b._done;
+        return a._piece.data() == b._piece.data() && a._last == b._last;
+    }
+
+    friend bool operator!=(const split_iterator &a, const split_iterator &b) noexcept { return !(a == b); }
+};
+
+class string_ref::split_range {
+    string_ref _text;
+    string_ref _separator;
+    char _separator_char;
+    bool _by_char;
+
+    friend class string_ref;
+
+    split_range(string_ref text, string_ref separator, char separator_char, bool by_char) noexcept
+        : _text(text), _separator(separator), _separator_char(separator_char), _by_char(by_char) {}
+
+public:
+    split_iterator begin() const noexcept { return split_iterator(_text, _separator, _separator_char, _by_char); }
+    split_iterator end() const noexcept { return split_iterator(); }
+};
+
+inline string_ref::split_range string_ref::split(char separator) const noexcept {
+    return split_range(*this, string_ref(), separator, true);
+}
+
+inline string_ref::split_range string_ref::split(string_ref separator) const noexcept {
+    return split_range(*this, separator, 0, false);
+}
@@ -0,0 +1,550 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstring>
+#include <memory>
+#include <new>
+#include <stdint.h>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "../spsc_queue/spsc_queue.hpp"
+#include "../spsc_queue/wait_policy.hpp"
+
+// Small executor for short pipeline tasks.
+//
+// Every (producer, worker) pair owns one SpscQueue, so submitting never takes
+// a lock. Workers move what arrives into their own work stealing deque, run
+// it LIFO, and steal FIFO from each other when they run dry. Idle workers
+// spin briefly, then park on a futex until a producer or a sibling wakes them.
+//
+//   ThreadPool pool(4);
+//   pool.submit([] { ... });
+//   pool.parallel_for(size, 64 * 1024, [&](size_t begin, size_t end) { ... });
+//
+// A Producer must only be used by one thread at a time. pool.submit() from
+// outside the pool goes through producer(0); tasks that submit more work go
+// straight to their own worker's deque.
+
+// Type erased, trivially copyable `void()` callable. Small trivially copyable
+// callables (lambdas capturing a few pointers) are stored inline, anything
+// else lives on the heap and is freed after it runs. A task runs exactly once.
+class Task
+{
+public:
+    Task() = default;
+
+    template <typename F, typename Fn = typename std::decay<F>::type,
+              typename = typename std::enable_if<!std::is_same<Fn, Task>::value>::type>
+    Task(F &&fn)
+    {
+        if constexpr (sizeof(Fn) <= __inline_size && alignof(Fn) <= alignof(std::max_align_t) &&
+                      std::is_trivially_copyable<Fn>::value && std::is_trivially_destructible<Fn>::value)
+        {
+            new (m_storage) Fn(std::forward<F>(fn));
+            m_invoke = [](void *storage)
+            { (*std::launder(reinterpret_cast<Fn *>(storage)))(); };
+        }
+        else
+        {
+            auto _fn = new Fn(std::forward<F>(fn));
+            std::memcpy(m_storage, &_fn, sizeof(_fn));
+            m_invoke = [](void *storage)
+            {
+                Fn *_fn;
+                std::memcpy(&_fn, storage, sizeof(_fn));
+                std::unique_ptr<Fn> _owner(_fn);
+                (*_fn)();
+            };
+        }
+    }
+
+    void operator()()
+    {
+        m_invoke(m_storage);
+    }
+
+    explicit operator bool() const
+    {
+        return m_invoke != nullptr;
+    }
+
+private:
+    static constexpr size_t __inline_size = 48;
+
+    void (*m_invoke)(void *) = nullptr;
+    alignas(std::max_align_t) unsigned char m_storage[__inline_size];
+};
+
+// Bounded Chase-Lev deque. The owner pushes and pops at the bottom, any other
+// thread steals from the top.
+template <size_t size = 4096>
+class StealDeque
+{
+    static_assert(size >= 2 && (size & (size - 1)) == 0, "size must be a power of two");
+    static_assert(std::is_trivially_copyable<Task>::value, "a losing thief discards its copy");
+    static_assert(sizeof(Task) % sizeof(uint64_t) == 0, "slots are copied in 64 bit words");
+
+public:
+    StealDeque()
+        : m_slot(new _Slot[size])
+    {
+    }
+
+    // owner only, false if full
+    bool push(const Task &task)
+    {
+        auto const _bottom = m_bottom.load(std::memory_order_relaxed);
+        auto const _top = m_top.load(std::memory_order_acquire);
+        if (_bottom - _top >= static_cast<int64_t>(size))
+        {
+            return false;
+        }
+        m_slot[_bottom & __mask].store(task);
+        m_bottom.store(_bottom + 1, std::memory_order_release);
+        return true;
+    }
+
+    // owner only, newest first
+    bool pop(Task &task)
+    {
+        auto const _bottom = m_bottom.load(std::memory_order_relaxed) - 1;
+        m_bottom.store(_bottom, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        auto _top = m_top.load(std::memory_order_relaxed);
+
+        if (_top > _bottom)
+        {
+            m_bottom.store(_bottom + 1, std::memory_order_relaxed);
+            return false;
+        }
+
+        task = m_slot[_bottom & __mask].load();
+        if (_top == _bottom)
+        {
+            // last element, race the thieves for it
+            bool _won = m_top.compare_exchange_strong(_top, _top + 1, std::memory_order_seq_cst, std::memory_order_relaxed);
+            m_bottom.store(_bottom + 1, std::memory_order_relaxed);
+            return _won;
+        }
+        return true;
+    }
+
+    // any thread, oldest first
+    bool steal(Task &task)
+    {
+        auto _top = m_top.load(std::memory_order_acquire);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        auto const _bottom = m_bottom.load(std::memory_order_acquire);
+        if (_top >= _bottom)
+        {
+            return false;
+        }
+        // the slot is not ours until the CAS wins: after a wrap the owner may be
+        // pushing into it right now, so it is read through atomics and a torn
+        // copy is simply thrown away with the lost CAS
+        task = m_slot[_top & __mask].load();
+        return m_top.compare_exchange_strong(_top, _top + 1, std::memory_order_seq_cst, std::memory_order_relaxed);
+    }
+
+    bool empty() const
+    {
+        return m_top.load(std::memory_order_acquire) >= m_bottom.load(std::memory_order_acquire);
+    }
+
+private:
+#ifdef __cpp_lib_hardware_interference_size
+    static constexpr size_t __chache_line_size =
+        std::hardware_destructive_interference_size;
+#else
+    static constexpr size_t __chache_line_size = 64;
+#endif
+
+    static constexpr int64_t __mask = size - 1;
+
+    // a Task as relaxed atomic words, so a thief may read a slot the owner is overwriting
+    struct _Slot
+    {
+        static constexpr size_t __words = sizeof(Task) / sizeof(uint64_t);
+
+        std::atomic<uint64_t> word[__words];
+
+        void store(const Task &task)
+        {
+            uint64_t _words[__words];
+            std::memcpy(_words, &task, sizeof(Task));
+            for (size_t i = 0; i < __words; ++i)
+                word[i].store(_words[i], std::memory_order_relaxed);
+        }
+
+        Task load() const
+        {
+            uint64_t _words[__words];
+            for (size_t i = 0; i < __words; ++i)
+                _words[i] = word[i].load(std::memory_order_relaxed);
+            Task _task;
+            std::memcpy(&_task, _words, sizeof(Task));
+            return _task;
+        }
+    };
+
+    std::unique_ptr<_Slot[]> m_slot;
+    alignas(__chache_line_size) std::atomic<int64_t> m_top{0};
+    alignas(__chache_line_size) std::atomic<int64_t> m_bottom{0};
+};
+
+class ThreadPool
+{
+    static constexpr size_t __ring_size = 1024;
+    static constexpr size_t __deque_size = 4096;
+    static constexpr size_t __drain_batch = 64;
+
+    using _Ring = SpscQueue<Task, __ring_size, SpinWait, SlotLayout<SlotStorage::Heap, SlotPadding::Packed>>;
+
+    struct _Worker
+    {
+        std::thread thread;
+        StealDeque<__deque_size> deque;
+        ParkWait<> park;
+        std::vector<std::unique_ptr<_Ring>> inbound; // one per producer
+    };
+
+    // which pool and worker the current thread belongs to
+    struct _Current
+    {
+        ThreadPool *pool = nullptr;
+        size_t index = 0;
+    };
+
+    static _Current &current()
+    {
+        static thread_local _Current _current;
+        return _current;
+    }
+
+public:
+    class Producer
+    {
+    public:
+        template <typename F>
+        void submit(F &&fn)
+        {
+            submit_task(Task(std::forward<F>(fn)));
+        }
+
+        // hand out `count` tasks, each worker is woken once per batch instead of once per task
+        void submit_batch(const Task *tasks, size_t count)
+        {
+            auto &_self = current();
+            if (_self.pool == m_pool)
+            {
+                auto &_worker = *m_pool->m_workers[_self.index];
+                for (size_t i = 0; i < count; ++i)
+                {
+                    Task _task = tasks[i];
+                    if (!_worker.deque.push(_task))
+                        _task();
+                }
+                m_pool->wake_sibling(_self.index);
+                return;
+            }
+
+            auto const _workers = m_pool->m_workers.size();
+            auto const _chunk = (count + _workers - 1) / _workers;
+            for (size_t _begin = 0; _begin < count; _begin += _chunk)
+            {
+                auto const _end = std::min(count, _begin + _chunk);
+                auto const _target = next_worker();
+                auto &_ring = *m_pool->m_workers[_target]->inbound[m_index];
+                for (size_t i = _begin; i < _end; ++i)
+                {
+                    if (!_ring.try_push(tasks[i]))
+                        place(tasks[i], _target);
+                }
+                m_pool->m_workers[_target]->park.notify();
+            }
+        }
+
+        // run fn(begin, end) over [0, count) in chunks of `grain`, return when all chunks are done
+        template <typename F>
+        void parallel_for(size_t count, size_t grain, F &&fn)
+        {
+            if (count == 0)
+                return;
+            grain = std::max<size_t>(grain, 1);
+
+            // lives on our stack: we may only leave once the last task has
+            // stopped touching it, which `exited` tells us
+            struct _Join
+            {
+                std::atomic<size_t> left;
+                std::atomic<bool> exited{false};
+                ParkWait<> done;
+            } _join;
+
+            auto const _chunks = (count + grain - 1) / grain;
+            _join.left.store(_chunks, std::memory_order_relaxed);
+
+            auto _fn = &fn;
+            auto _pjoin = &_join;
+            std::vector<Task> _tasks;
+            _tasks.reserve(_chunks);
+            for (size_t _begin = 0; _begin < count; _begin += grain)
+            {
+                auto const _end = std::min(count, _begin + grain);
+                _tasks.emplace_back([_fn, _pjoin, _begin, _end]
+                                    {
+                    (*_fn)(_begin, _end);
+                    if (_pjoin->left.fetch_sub(1, std::memory_order_acq_rel) == 1)
+                    {
+                        _pjoin->done.notify();
+                        _pjoin->exited.store(true, std::memory_order_release);
+                    } });
+            }
+            submit_batch(_tasks.data(), _tasks.size());
+
+            auto _finished = [&]
+            { return _join.left.load(std::memory_order_acquire) == 0; };
+
+            auto &_self = current();
+            if (_self.pool == m_pool)
+            {
+                // a worker must keep running tasks while it waits, or nested loops deadlock
+                while (!_finished())
+                {
+                    if (!m_pool->run_one(_self.index))
+                        spsc_detail::cpu_relax();
+                }
+            }
+            else
+            {
+                _join.done.wait(_finished, spsc_detail::forever);
+            }
+
+            while (!_join.exited.load(std::memory_order_acquire))
+                spsc_detail::cpu_relax();
+        }
+
+    private:
+        friend class ThreadPool;
+
+        Producer(ThreadPool *pool, size_t index) : m_pool(pool), m_index(index) {}
+
+        size_t next_worker()
+        {
+            auto _target = m_cursor;
+            m_cursor = m_cursor + 1 == m_pool->m_workers.size() ? 0 : m_cursor + 1;
+            return _target;
+        }
+
+        void submit_task(const Task &task)
+        {
+            auto &_self = current();
+            if (_self.pool == m_pool)
+            {
+                // from inside a task: keep it local and cache warm, let a sibling steal it
+                if (!m_pool->m_workers[_self.index]->deque.push(task))
+                {
+                    Task _task = task;
+                    _task();
+                    return;
+                }
+                m_pool->wake_sibling(_self.index);
+                return;
+            }
+            place(task, next_worker());
+        }
+
+        // try every ring starting at `first`, run the task here if all are full
+        void place(const Task &task, size_t first)
+        {
+            auto const _workers = m_pool->m_workers.size();
+            for (size_t i = 0; i < _workers; ++i)
+            {
+                auto const _target = (first + i) % _workers;
+                auto &_worker = *m_pool->m_workers[_target];
+                if (_worker.inbound[m_index]->try_push(task))
+                {
+                    _worker.park.notify();
+                    return;
+                }
+            }
+            Task _task = task;
+            _task();
+        }
+
+        ThreadPool *m_pool;
+        size_t m_index;
+        size_t m_cursor = 0;
+    };
+
+    explicit ThreadPool(size_t workers = std::thread::hardware_concurrency(), size_t producers = 1)
+    {
+        workers = std::max<size_t>(workers, 1);
+        producers = std::max<size_t>(producers, 1);
+
+        for (size_t i = 0; i < workers; ++i)
+        {
+            auto _worker = std::make_unique<_Worker>();
+            for (size_t p = 0; p < producers; ++p)
+                _worker->inbound.emplace_back(std::make_unique<_Ring>());
+            m_workers.emplace_back(std::move(_worker));
+        }
+        for (size_t p = 0; p < producers; ++p)
+        {
+            m_producers.emplace_back(Producer(this, p));
+            m_producers.back().m_cursor = p % workers;
+        }
+        for (size_t i = 0; i < workers; ++i)
+        {
+            m_workers[i]->thread = std::thread([this, i]
+                                               { run(i); });
+        }
+    }
+
+    // runs everything already submitted, then joins the workers
+    ~ThreadPool()
+    {
+        m_stop.store(true, std::memory_order_release);
+        for (auto &_worker : m_workers)
+            _worker->park.notify();
+        for (auto &_worker : m_workers)
+            _worker->thread.join();
+    }
+
+    ThreadPool(const ThreadPool &_) = delete;
+    ThreadPool &operator=(const ThreadPool &_) = delete;
+
+    size_t size() const
+    {
+        return m_workers.size();
+    }
+
+    Producer &producer(size_t index)
+    {
+        return m_producers[index];
+    }
+
+    template <typename F>
+    void submit(F &&fn)
+    {
+        m_producers[0].submit(std::forward<F>(fn));
+    }
+
+    void submit_batch(const Task *tasks, size_t count)
+    {
+        m_producers[0].submit_batch(tasks, count);
+    }
+
+    template <typename F>
+    void parallel_for(size_t count, size_t grain, F &&fn)
+    {
+        m_producers[0].parallel_for(count, grain, std::forward<F>(fn));
+    }
+
+private:
+    // move a batch from the inbound rings into the deque, true if anything arrived
+    bool drain(_Worker &worker)
+    {
+        size_t _moved = 0;
+        Task _task;
+        for (auto &_ring : worker.inbound)
+        {
+            for (size_t n = 0; n < __drain_batch && _ring->try_pop(_task); ++n, ++_moved)
+            {
+                if (!worker.deque.push(_task))
+                    _task();
+            }
+        }
+        return _moved != 0;
+    }
+
+    bool steal(size_t index, Task &task)
+    {
+        auto const _workers = m_workers.size();
+        for (size_t i = 1; i < _workers; ++i)
+        {
+            if (m_workers[(index + i) % _workers]->deque.steal(task))
+                return true;
+        }
+        return false;
+    }
+
+    // run one task from our deque, our rings or a sibling, false if there was none
+    bool run_one(size_t index)
+    {
+        auto &_worker = *m_workers[index];
+        Task _task;
+        if (_worker.deque.pop(_task))
+        {
+            _task();
+            return true;
+        }
+        if (drain(_worker))
+        {
+            wake_sibling(index);
+            return true;
+        }
+        if (steal(index, _task))
+        {
+            _task();
+            return true;
+        }
+        return false;
+    }
+
+    bool has_work(size_t index)
+    {
+        auto &_worker = *m_workers[index];
+        if (!_worker.deque.empty())
+            return true;
+        for (auto &_ring : _worker.inbound)
+        {
+            if (!_ring->empty())
+                return true;
+        }
+        for (auto &_other : m_workers)
+        {
+            if (!_other->deque.empty())
+                return true;
+        }
+        return false;
+    }
+
+    void wake_sibling(size_t index)
+    {
+        if (m_workers.size() > 1)
+            m_workers[(index + 1) % m_workers.size()]->park.notify();
+    }
+
+    void run(size_t index)
+    {
+        current() = _Current{this, index};
+        auto &_worker = *m_workers[index];
+
+        for (;;)
+        {
+            if (run_one(index))
+                continue;
+
+            if (m_stop.load(std::memory_order_acquire) && !has_work(index))
+                break;
+
+            // a sibling may fill its deque without waking us, so never sleep for long
+            auto _ready = [&]
+            { return m_stop.load(std::memory_order_acquire) || has_work(index); };
+            _worker.park.wait(_ready, spsc_detail::clock::now() + std::chrono::milliseconds(1));
+        }
+
+        current() = _Current{};
+    }
+
+    std::vector<std::unique_ptr<_Worker>> m_workers;
+    std::vector<Producer> m_producers;
+    std::atomic<bool> m_stop{false};
+};
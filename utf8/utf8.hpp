@@ -0,0 +1,407 @@
+#pragma once
+
+#include <cstring>
+#include <stdint.h>
+#include <string>
+
+#if defined(__AVX2__) || defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define UTF8_SSE2 1
+#include <emmintrin.h>
+#endif
+
+#if defined(__AVX2__) || defined(__AVX__) || defined(__SSSE3__)
+#define UTF8_SSSE3 1
+#include <tmmintrin.h>
+#endif
+
+#if defined(__AVX2__)
+#define UTF8_AVX2 1
+#include <immintrin.h>
+#endif
+
+// UTF-8 validation and UTF-8 <-> UTF-16 conversion.
+//
+// validate() is the lookup table algorithm of Keiser and Lemire ("Validating
+// UTF-8 in less than one instruction per byte"): three 16 entry tables
+// indexed by the nibbles of each byte and of the byte before it flag every
+// illegal two byte pair, a saturating subtract catches missing 3rd / 4th
+// continuation bytes, and all-ASCII blocks skip straight through. It needs
+// SSSE3 (pshufb); AVX2 builds do 32 bytes per step.
+//
+// The converters validate first and then decode without any checks, with
+// SSE2 loops that widen / narrow whole ASCII blocks at once. Invalid input
+// (bad UTF-8, unpaired surrogates) makes them return npos.
+
+namespace utf8 {
+    constexpr size_t npos = static_cast<size_t>(-1);
+
+    namespace detail {
+        // bit per error class, a byte pair is invalid when all three lookups agree on one
+        constexpr uint8_t too_short = 1 << 0;      // 11______ 0_______ or 11______ 11______
+        constexpr uint8_t too_long = 1 << 1;       // 0_______ 10______
+        constexpr uint8_t overlong_3 = 1 << 2;     // 11100000 100_____
+        constexpr uint8_t too_large = 1 << 3;      // 11110100 1001____ and up
+        constexpr uint8_t surrogate = 1 << 4;      // 11101101 101_____
+        constexpr uint8_t overlong_2 = 1 << 5;     // 1100000_ 10______
+        constexpr uint8_t too_large_1000 = 1 << 6; // 11110101 1000____ and up
+        constexpr uint8_t overlong_4 = 1 << 6;     // 11110000 1000____
+        constexpr uint8_t two_conts = 1 << 7;      // 10______ 10______
+        constexpr uint8_t carry = too_short | too_long | two_conts;
+
+#define UTF8_BYTE_1_HIGH                                                        \
+    too_long, too_long, too_long, too_long, too_long, too_long, too_long, too_long, \
+        two_conts, two_conts, two_conts, two_conts,                             \
+        too_short | overlong_2,                                                 \
+        too_short,                                                              \
+        too_short | overlong_3 | surrogate,                                     \
+        too_short | too_large | too_large_1000 | overlong_4
+
+#define UTF8_BYTE_1_LOW                                                         \
+    carry | overlong_3 | overlong_2 | overlong_4,                               \
+        carry | overlong_2,                                                     \
+        carry, carry,                                                           \
+        carry | too_large,                                                      \
+        carry | too_large | too_large_1000,                                     \
+        carry | too_large | too_large_1000, carry | too_large | too_large_1000, \
+        carry | too_large | too_large_1000, carry | too_large | too_large_1000, \
+        carry | too_large | too_large_1000, carry | too_large | too_large_1000, \
+        carry | too_large | too_large_1000,                                     \
+        carry | too_large | too_large_1000 | surrogate,                         \
+        carry | too_large | too_large_1000, carry | too_large | too_large_1000
+
+#define UTF8_BYTE_2_HIGH                                                                    \
+    too_short, too_short, too_short, too_short, too_short, too_short, too_short, too_short, \
+        too_long | overlong_2 | two_conts | overlong_3 | too_large_1000 | overlong_4,       \
+        too_long | overlong_2 | two_conts | overlong_3 | too_large,                         \
+        too_long | overlong_2 | two_conts | surrogate | too_large,                          \
+        too_long | overlong_2 | two_conts | surrogate | too_large,                          \
+        too_short, too_short, too_short, too_short
+
+#if defined(UTF8_SSSE3)
+        struct sse_t {
+            using vec = __m128i;
+            static constexpr size_t width = 16;
+
+            static vec load(const char *data) { return _mm_loadu_si128(reinterpret_cast<const __m128i *>(data)); }
+            static vec zero() { return _mm_setzero_si128(); }
+            static vec splat(uint8_t value) { return _mm_set1_epi8(static_cast<char>(value)); }
+            static vec op_and(vec a, vec b) { return _mm_and_si128(a, b); }
+            static vec op_or(vec a, vec b) { return _mm_or_si128(a, b); }
+            static vec op_xor(vec a, vec b) { return _mm_xor_si128(a, b); }
+            static vec saturating_sub(vec a, vec b) { return _mm_subs_epu8(a, b); }
+            static vec high_nibbles(vec v) { return _mm_and_si128(_mm_srli_epi16(v, 4), splat(0x0F)); }
+            static vec low_nibbles(vec v) { return _mm_and_si128(v, splat(0x0F)); }
+            static bool is_ascii(vec v) { return _mm_movemask_epi8(v) == 0; }
+            static bool any(vec v) { return _mm_movemask_epi8(_mm_cmpeq_epi8(v, zero())) != 0xFFFF; }
+
+            template <uint8_t... bytes>
+            static vec table() { return _mm_setr_epi8(static_cast<char>(bytes)...); }
+
+            static vec lookup(vec table, vec nibbles) { return _mm_shuffle_epi8(table, nibbles); }
+
+            // `input` shifted right by n bytes, the gap filled from the end of `previous`
+            template <int n>
+            static vec prev(vec input, vec previous) { return _mm_alignr_epi8(input, previous, 16 - n); }
+
+            // largest byte that does not start a sequence running past the block
+            static vec incomplete_max() {
+                return table<0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+                             0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xF0 - 1, 0xE0 - 1, 0xC0 - 1>();
+            }
+        };
+#endif
+
+#if defined(UTF8_AVX2)
+        struct avx2_t {
+            using vec = __m256i;
+            static constexpr size_t width = 32;
+
+            static vec load(const char *data) { return _mm256_loadu_si256(reinterpret_cast<const __m256i *>(data)); }
+            static vec zero() { return _mm256_setzero_si256(); }
+            static vec splat(uint8_t value) { return _mm256_set1_epi8(static_cast<char>(value)); }
+            static vec op_and(vec a, vec b) { return _mm256_and_si256(a, b); }
+            static vec op_or(vec a, vec b) { return _mm256_or_si256(a, b); }
+            static vec op_xor(vec a, vec b) { return _mm256_xor_si256(a, b); }
+            static vec saturating_sub(vec a, vec b) { return _mm256_subs_epu8(a, b); }
+            static vec high_nibbles(vec v) { return _mm256_and_si256(_mm256_srli_epi16(v, 4), splat(0x0F)); }
+            static vec low_nibbles(vec v) { return _mm256_and_si256(v, splat(0x0F)); }
+            static bool is_ascii(vec v) { return _mm256_movemask_epi8(v) == 0; }
+            static bool any(vec v) { return !_mm256_testz_si256(v, v); }
+
+            // pshufb works per 128 bit lane, so the table is repeated in both
+            template <uint8_t... bytes>
+            static vec table() { return _mm256_setr_epi8(static_cast<char>(bytes)..., static_cast<char>(bytes)...); }
+
+            static vec lookup(vec table, vec nibbles) { return _mm256_shuffle_epi8(table, nibbles); }
+
+            template <int n>
+            static vec prev(vec input, vec previous) {
+                return _mm256_alignr_epi8(input, _mm256_permute2x128_si256(previous, input, 0x21), 16 - n);
+            }
+
+            static vec incomplete_max() {
+                return _mm256_setr_epi8(-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+                                        -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+                                        static_cast<char>(0xF0 - 1), static_cast<char>(0xE0 - 1), static_cast<char>(0xC0 - 1));
+            }
+        };
+#endif
+
+#if defined(UTF8_SSSE3)
+        template <typename V>
+        class checker_t {
+            using vec = typename V::vec;
+
+            vec _error = V::zero();
+            vec _prev_input = V::zero();
+            vec _prev_incomplete = V::zero();
+
+        public:
+            void check(vec input) {
+                if (V::is_ascii(input)) {
+                    // only a sequence left open by the previous block can fail here
+                    _error = V::op_or(_error, _prev_incomplete);
+                    _prev_incomplete = V::zero();
+                    _prev_input = input;
+                    return;
+                }
+
+                auto prev1 = V::template prev<1>(input, _prev_input);
+                auto byte_1_high = V::lookup(V::template table<UTF8_BYTE_1_HIGH>(), V::high_nibbles(prev1));
+                auto byte_1_low = V::lookup(V::template table<UTF8_BYTE_1_LOW>(), V::low_nibbles(prev1));
+                auto byte_2_high = V::lookup(V::template table<UTF8_BYTE_2_HIGH>(), V::high_nibbles(input));
+                auto special = V::op_and(V::op_and(byte_1_high, byte_1_low), byte_2_high);
+
+                // two bytes after a 3 / 4 byte lead must be continuations; that
+                // is exactly the two_conts bit, anything else left over is an error
+                auto prev2 = V::template prev<2>(input, _prev_input);
+                auto prev3 = V::template prev<3>(input, _prev_input);
+                auto must_be_continuation = V::op_or(V::saturating_sub(prev2, V::splat(0xE0 - 0x80)),
+                                                     V::saturating_sub(prev3, V::splat(0xF0 - 0x80)));
+                auto expected = V::op_and(must_be_continuation, V::splat(0x80));
+                _error = V::op_or(_error, V::op_xor(expected, special));
+
+                _prev_incomplete = V::saturating_sub(input, V::incomplete_max());
+                _prev_input = input;
+            }
+
+            bool failed() const { return V::any(_error); }
+        };
+
+        template <typename V>
+        bool validate(const char *data, size_t size) noexcept {
+            checker_t<V> checker;
+            size_t i = 0;
+            for (; i + V::width <= size; i += V::width)
+                checker.check(V::load(data + i));
+
+            // zero padding is ASCII, so a sequence cut short by the end of input fails here too
+            char tail[V::width] = {};
+            std::memcpy(tail, data + i, size - i);
+            checker.check(V::load(tail));
+            return !checker.failed();
+        }
+#endif
+
+#undef UTF8_BYTE_1_HIGH
+#undef UTF8_BYTE_1_LOW
+#undef UTF8_BYTE_2_HIGH
+
+        inline bool validate_scalar(const char *data, size_t size) noexcept {
+            auto bytes = reinterpret_cast<const unsigned char *>(data);
+            size_t i = 0;
+            while (i < size) {
+                uint32_t c = bytes[i];
+                if (c < 0x80) {
+                    ++i;
+                    continue;
+                }
+
+                size_t length;
+                uint32_t min;
+                if ((c & 0xE0) == 0xC0) {
+                    length = 2, c &= 0x1F, min = 0x80;
+                } else if ((c & 0xF0) == 0xE0) {
+                    length = 3, c &= 0x0F, min = 0x800;
+                } else if ((c & 0xF8) == 0xF0) {
+                    length = 4, c &= 0x07, min = 0x10000;
+                } else {
+                    return false;
+                }
+
+                if (size - i < length)
+                    return false;
+                for (size_t k = 1; k < length; ++k) {
+                    if ((bytes[i + k] & 0xC0) != 0x80)
+                        return false;
+                    c = (c << 6) | (bytes[i + k] & 0x3F);
+                }
+                if (c < min || c > 0x10FFFF || (c >= 0xD800 && c <= 0xDFFF))
+                    return false;
+                i += length;
+            }
+            return true;
+        }
+    }
+
+    inline bool is_ascii(const char *data, size_t size) noexcept {
+        size_t i = 0;
+#if defined(UTF8_SSE2)
+        auto high = _mm_setzero_si128();
+        for (; i + 16 <= size; i += 16)
+            high = _mm_or_si128(high, _mm_loadu_si128(reinterpret_cast<const __m128i *>(data + i)));
+        if (_mm_movemask_epi8(high) != 0)
+            return false;
+#endif
+        for (; i < size; ++i) {
+            if (static_cast<unsigned char>(data[i]) >= 0x80)
+                return false;
+        }
+        return true;
+    }
+
+    inline bool validate(const char *data, size_t size) noexcept {
+#if defined(UTF8_AVX2)
+        return detail::validate<detail::avx2_t>(data, size);
+#elif defined(UTF8_SSSE3)
+        return detail::validate<detail::sse_t>(data, size);
+#else
+        return detail::validate_scalar(data, size);
+#endif
+    }
+
+    inline bool validate(const std::string &str) noexcept {
+        return validate(str.data(), str.size());
+    }
+
+    // writes 1 to 4 bytes, `code_point` must be a valid scalar value
+    inline size_t encode(uint32_t code_point, char *out) noexcept {
+        if (code_point < 0x80) {
+            out[0] = static_cast<char>(code_point);
+            return 1;
+        }
+        if (code_point < 0x800) {
+            out[0] = static_cast<char>(0xC0 | (code_point >> 6));
+            out[1] = static_cast<char>(0x80 | (code_point & 0x3F));
+            return 2;
+        }
+        if (code_point < 0x10000) {
+            out[0] = static_cast<char>(0xE0 | (code_point >> 12));
+            out[1] = static_cast<char>(0x80 | ((code_point >> 6) & 0x3F));
+            out[2] = static_cast<char>(0x80 | (code_point & 0x3F));
+            return 3;
+        }
+        out[0] = static_cast<char>(0xF0 | (code_point >> 18));
+        out[1] = static_cast<char>(0x80 | ((code_point >> 12) & 0x3F));
+        out[2] = static_cast<char>(0x80 | ((code_point >> 6) & 0x3F));
+        out[3] = static_cast<char>(0x80 | (code_point & 0x3F));
+        return 4;
+    }
+
+    // `out` needs room for `size` units, returns the units written or npos
+    template <typename Char16>
+    size_t to_utf16(const char *data, size_t size, Char16 *out) noexcept {
+        static_assert(sizeof(Char16) == 2, "UTF-16 code units are 2 bytes");
+
+        if (!validate(data, size))
+            return npos;
+
+        auto bytes = reinterpret_cast<const unsigned char *>(data);
+        size_t i = 0;
+        size_t written = 0;
+        while (i < size) {
+#if defined(UTF8_SSE2)
+            for (; i + 16 <= size; i += 16, written += 16) {
+                auto block = _mm_loadu_si128(reinterpret_cast<const __m128i *>(bytes + i));
+                if (_mm_movemask_epi8(block) != 0)
+                    break;
+                auto zero = _mm_setzero_si128();
+                _mm_storeu_si128(reinterpret_cast<__m128i *>(out + written), _mm_unpacklo_epi8(block, zero));
+                _mm_storeu_si128(reinterpret_cast<__m128i *>(out + written + 8), _mm_unpackhi_epi8(block, zero));
+            }
+            if (i == size)
+                break;
+#endif
+            // already validated, so only the lead byte has to be looked at
+            uint32_t c = bytes[i];
+            if (c < 0x80) {
+                out[written++] = static_cast<Char16>(c);
+                i += 1;
+            } else if (c < 0xE0) {
+                out[written++] = static_cast<Char16>(((c & 0x1F) << 6) | (bytes[i + 1] & 0x3F));
+                i += 2;
+            } else if (c < 0xF0) {
+                out[written++] = static_cast<Char16>(((c & 0x0F) << 12) | ((bytes[i + 1] & 0x3F) << 6) | (bytes[i + 2] & 0x3F));
+                i += 3;
+            } else {
+                auto code_point = ((c & 0x07) << 18) | ((bytes[i + 1] & 0x3F) << 12) |
+                                  ((bytes[i + 2] & 0x3F) << 6) | (bytes[i + 3] & 0x3F);
+                code_point -= 0x10000;
+                out[written++] = static_cast<Char16>(0xD800 | (code_point >> 10));
+                out[written++] = static_cast<Char16>(0xDC00 | (code_point & 0x3FF));
+                i += 4;
+            }
+        }
+        return written;
+    }
+
+    // `out` needs room for 3 * `size` bytes, returns the bytes written or npos
+    template <typename Char16>
+    size_t from_utf16(const Char16 *data, size_t size, char *out) noexcept {
+        static_assert(sizeof(Char16) == 2, "UTF-16 code units are 2 bytes");
+
+        size_t i = 0;
+        size_t written = 0;
+        while (i < size) {
+#if defined(UTF8_SSE2)
+            for (; i + 8 <= size; i += 8, written += 8) {
+                auto block = _mm_loadu_si128(reinterpret_cast<const __m128i *>(data + i));
+                auto high = _mm_and_si128(block, _mm_set1_epi16(static_cast<short>(0xFF80)));
+                if (_mm_movemask_epi8(_mm_cmpeq_epi16(high, _mm_setzero_si128())) != 0xFFFF)
+                    break;
+                _mm_storel_epi64(reinterpret_cast<__m128i *>(out + written), _mm_packus_epi16(block, block));
+            }
+            if (i == size)
+                break;
+#endif
+            uint32_t c = static_cast<uint16_t>(data[i++]);
+            if (c >= 0xD800 && c <= 0xDFFF) {
+                if (c >= 0xDC00 || i == size)
+                    return npos;
+                uint32_t low = static_cast<uint16_t>(data[i]);
+                if (low < 0xDC00 || low > 0xDFFF)
+                    return npos;
+                c = 0x10000 + ((c - 0xD800) << 10) + (low - 0xDC00);
+                ++i;
+            }
+            written += encode(c, out + written);
+        }
+        return written;
+    }
+
+    template <typename Char16>
+    bool to_utf16(const std::string &str, std::basic_string<Char16> &out) {
+        // never more UTF-16 units than UTF-8 bytes
+        out.resize(str.size());
+        auto written = to_utf16(str.data(), str.size(), &out[0]);
+        if (written == npos) {
+            out.clear();
+            return false;
+        }
+        out.resize(written);
+        return true;
+    }
+
+    template <typename Char16>
+    bool from_utf16(const std::basic_string<Char16> &str, std::string &out) {
+        // a unit is at most 3 bytes, a surrogate pair is 4 bytes for 2 units
+        out.resize(str.size() * 3);
+        auto written = from_utf16(str.data(), str.size(), &out[0]);
+        if (written == npos) {
+            out.clear();
+            return false;
+        }
+        out.resize(written);
+        return true;
+    }
+}
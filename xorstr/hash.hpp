@@ -0,0 +1,223 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Compile time string hashing and perfect hash dispatch.
+//
+//   switch (utility::fnv1a(name, size)) {
+//   case "get"_hash: ...        // plain hash switch, compare the string too
+//   }
+//
+//   constexpr auto commands = utility::make_perfect_hash({ "get", "set", "del" });
+//   switch (commands.find(name, size)) {
+//   case commands.index_of("get"): ...
+//   case commands.index_of("set"): ...
+//   default: ...                 // -1, not a key
+//   }
+//
+// The perfect hash table is built by the compiler (hash and displace: keys
+// are grouped into buckets by one mix of their hash, then every bucket,
+// fullest first, gets the seed that moves all its keys into free slots), so
+// a lookup is one hash, two mixes and one compare, with nothing set up at
+// startup. Meant for fixed key sets up to a few hundred keys; bigger sets
+// run into the compiler's constexpr step limit.
+
+namespace utility
+{
+    constexpr uint32_t fnv1a(const char* data, size_t size, uint32_t basis = 2166136261u)
+    {
+        uint32_t hash = basis;
+        for (size_t i = 0; i < size; ++i) {
+            hash = (hash ^ static_cast<uint8_t>(data[i])) * 16777619u;
+        }
+        return hash;
+    }
+
+    constexpr size_t length(const char* str)
+    {
+        size_t size = 0;
+        while (str[size] != '\0') {
+            ++size;
+        }
+        return size;
+    }
+
+    constexpr uint32_t fnv1a(const char* str)
+    {
+        return fnv1a(str, length(str));
+    }
+
+    namespace literals
+    {
+        constexpr uint32_t operator""_hash(const char* data, size_t size)
+        {
+            return fnv1a(data, size);
+        }
+    }
+
+    // murmur3 finalizer, spreads the seed into every bit of the FNV hash so
+    // the low bits used as table index change with each seed tried
+    constexpr uint32_t mix(uint32_t hash, uint32_t seed)
+    {
+        hash ^= seed * 0x9E3779B9u;
+        hash ^= hash >> 16;
+        hash *= 0x85EBCA6Bu;
+        hash ^= hash >> 13;
+        hash *= 0xC2B2AE35u;
+        hash ^= hash >> 16;
+        return hash;
+    }
+
+    // not constexpr on purpose: reaching one of these during constant
+    // evaluation turns into a compile error naming the problem
+    void perfect_hash_duplicate_key();
+    void perfect_hash_same_fnv1a_hash(); // two keys collide on the full hash, no seed can tell them apart
+    void perfect_hash_unknown_key();
+
+    template<size_t K>
+    class perfect_hash
+    {
+        static_assert(K > 0 && K < 0xFFFF, "key count out of range");
+
+        static constexpr size_t round_up_pow2(size_t value)
+        {
+            size_t result = 1;
+            while (result < value) {
+                result <<= 1;
+            }
+            return result;
+        }
+
+    public:
+        static constexpr size_t bucket_count = round_up_pow2(K);
+
+        // half full at most, so a free placement for every bucket turns up quickly
+        static constexpr size_t table_size = round_up_pow2(K * 2);
+
+        constexpr explicit perfect_hash(const char* const (&keys)[K])
+            : m_keys{}, m_sizes{}, m_slots{}, m_seeds{}
+        {
+            uint32_t hashes[K] = {};
+            for (size_t i = 0; i < K; ++i) {
+                m_keys[i] = keys[i];
+                m_sizes[i] = length(keys[i]);
+                hashes[i] = fnv1a(keys[i], m_sizes[i]);
+                for (size_t j = 0; j < i; ++j) {
+                    if (equal(m_keys[j], m_sizes[j], keys[i], m_sizes[i])) {
+                        perfect_hash_duplicate_key();
+                    }
+                    // the seed search below would never end
+                    if (hashes[j] == hashes[i]) {
+                        perfect_hash_same_fnv1a_hash();
+                    }
+                }
+            }
+
+            size_t bucket_sizes[bucket_count] = {};
+            size_t largest = 0;
+            for (size_t i = 0; i < K; ++i) {
+                auto size = ++bucket_sizes[bucket_of(hashes[i])];
+                largest = size > largest ? size : largest;
+            }
+
+            for (auto size = largest; size > 0; --size) {
+                for (size_t bucket = 0; bucket < bucket_count; ++bucket) {
+                    if (bucket_sizes[bucket] != size) {
+                        continue;
+                    }
+                    for (uint32_t seed = 1;; ++seed) {
+                        if (try_place(hashes, bucket, seed)) {
+                            m_seeds[bucket] = seed;
+                            break;
+                        }
+                    }
+                }
+            }
+        }
+
+        // index of the key, -1 when `data` is not one of them
+        constexpr int find(const char* data, size_t size) const
+        {
+            auto hash = fnv1a(data, size);
+            auto slot = m_slots[mix(hash, m_seeds[bucket_of(hash)]) & (table_size - 1)];
+            if (slot == 0) {
+                return -1;
+            }
+
+            auto index = slot - 1;
+            return equal(m_keys[index], m_sizes[index], data, size) ? static_cast<int>(index) : -1;
+        }
+
+        constexpr int find(const char* str) const
+        {
+            return find(str, length(str));
+        }
+
+        // for case labels, refuses to compile for a string outside the key set
+        constexpr int index_of(const char* key) const
+        {
+            auto index = find(key);
+            if (index < 0) {
+                perfect_hash_unknown_key();
+            }
+            return index;
+        }
+
+        constexpr const char* key(size_t index) const { return m_keys[index]; }
+        constexpr size_t size() const { return K; }
+
+    private:
+        static constexpr bool equal(const char* a, size_t a_size, const char* b, size_t b_size)
+        {
+            if (a_size != b_size) {
+                return false;
+            }
+            for (size_t i = 0; i < a_size; ++i) {
+                if (a[i] != b[i]) {
+                    return false;
+                }
+            }
+            return true;
+        }
+
+        static constexpr size_t bucket_of(uint32_t hash)
+        {
+            return mix(hash, 0) & (bucket_count - 1);
+        }
+
+        // claims slots for every key of `bucket`, or leaves the table untouched
+        constexpr bool try_place(const uint32_t (&hashes)[K], size_t bucket, uint32_t seed)
+        {
+            size_t placed[K] = {};
+            size_t count = 0;
+            for (size_t i = 0; i < K; ++i) {
+                if (bucket_of(hashes[i]) != bucket) {
+                    continue;
+                }
+
+                auto index = mix(hashes[i], seed) & (table_size - 1);
+                if (m_slots[index] != 0) {
+                    while (count > 0) {
+                        m_slots[placed[--count]] = 0;
+                    }
+                    return false;
+                }
+                m_slots[index] = static_cast<uint16_t>(i + 1);
+                placed[count++] = index;
+            }
+            return true;
+        }
+
+        const char* m_keys[K];
+        size_t m_sizes[K];
+        uint16_t m_slots[table_size]; // key index + 1, 0 for an empty slot
+        uint32_t m_seeds[bucket_count];
+    };
+
+    template<size_t K>
+    constexpr perfect_hash<K> make_perfect_hash(const char* const (&keys)[K])
+    {
+        return perfect_hash<K>(keys);
+    }
+}
@@ -1,7 +1,24 @@
 #pragma once
 
+#include <stddef.h>
 #include <stdint.h>
 
+#if defined(__AVX2__) || defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define XORSTR_SSE2 1
+#include <emmintrin.h>
+#endif
+
+#if defined(__AVX2__)
+#define XORSTR_AVX2 1
+#include <immintrin.h>
+#endif
+
+#if defined(_MSC_VER)
+#define XORSTR_FORCEINLINE __forceinline
+#else
+#define XORSTR_FORCEINLINE __attribute__((always_inline)) inline
+#endif
+
 // form guidedhacking.com
 
 namespace utility
@@ -39,19 +56,31 @@ namespace utility
     template <size_t N> using make_index_sequence = decay<decltype(make_index_sequence_impl<N>())>;
 
     // use time string macro to initialise seed for cipher
-    constexpr uint32_t initial_seed()
+    // (the XOR macro passes its own __TIME__ so every translation unit agrees on this function)
+    constexpr uint32_t initial_seed(const char* time = __TIME__)
     {
         uint32_t seed = 0;
-        seed += (__TIME__[0] - '0') * 36000;    // 10s of hours
-        seed += (__TIME__[1] - '0') * 3600;        // %10 of hours
-        seed += (__TIME__[3] - '0') * 600;        // 10s of minutes
-        seed += (__TIME__[4] - '0') * 60;        // %10 of minutes
-        seed += (__TIME__[6] - '0') * 10;        // 10s of seconds
-        seed += (__TIME__[7] - '0');            // %10 of seconds
+        seed += (time[0] - '0') * 36000;    // 10s of hours
+        seed += (time[1] - '0') * 3600;        // %10 of hours
+        seed += (time[3] - '0') * 600;        // 10s of minutes
+        seed += (time[4] - '0') * 60;        // %10 of minutes
+        seed += (time[6] - '0') * 10;        // 10s of seconds
+        seed += (time[7] - '0');            // %10 of seconds
         return seed;
     }
 
-    uint32_t seed = initial_seed();
+    // one seed per string: build time mixed with the position of the literal
+    constexpr uint32_t string_seed(const char* time, uint32_t counter, uint32_t line)
+    {
+        const uint32_t values[] = { initial_seed(time), counter, line };
+        uint32_t hash = 2166136261u;
+        for (uint32_t value : values) {
+            for (int i = 0; i < 4; ++i) {
+                hash = (hash ^ ((value >> (i * 8)) & 0xFF)) * 16777619u;
+            }
+        }
+        return 1 + hash % 2147483646u; // the LCG is stuck at 0
+    }
 
     // linear congruential generator for compile time keys
     // same parameters as minstd_rand: http://www.cplusplus.com/reference/random/minstd_rand/
@@ -61,35 +90,127 @@ namespace utility
         return static_cast<const uint32_t>(key_seed);
     }
 
-    // encrypt at compile time, decrypt at run time using basic XOR cipher
-    template<class TYPE, size_t N>
+    // one key per element, expanded at compile time
+    template<class TYPE, size_t COUNT, uint32_t SEED>
+    struct key_stream
+    {
+        alignas(32) TYPE data[COUNT];
+
+        constexpr key_stream() : data{}
+        {
+            uint32_t key_seed = SEED;
+            for (size_t i = 0; i < COUNT; ++i) {
+                data[i] = static_cast<TYPE>(generate_key(key_seed) >> 7); // low LCG bits are the weak ones
+            }
+        }
+    };
+
+    // The optimizer can see both the ciphertext and the key stream, and would
+    // happily fold the XOR back into plaintext constants. Loading the key
+    // pointer through a volatile hides where it points.
+    template<class T>
+    XORSTR_FORCEINLINE const T* opaque(const T* ptr)
+    {
+        const T* volatile hidden = ptr;
+        return hidden;
+    }
+
+    // encrypt at compile time, decrypt at run time using basic XOR cipher.
+    // The buffer is padded to whole 32 byte blocks (the padding decrypts to
+    // 0) so get() runs one SIMD XOR per block with no scalar tail.
+    template<class TYPE, size_t N, uint32_t SEED>
     class xor_string
     {
+        static constexpr size_t block_size = 32;
+        static constexpr size_t count = ((N + 1) * sizeof(TYPE) + block_size - 1) / block_size * block_size / sizeof(TYPE);
+
+        static_assert(block_size % sizeof(TYPE) == 0, "element size must divide the block size");
+
+        static constexpr key_stream<TYPE, count, SEED> m_keys{};
+
     public:
-        template<size_t... I>
-        constexpr __forceinline xor_string(const TYPE* buffer, index_sequence<I...>)
-            : m_key{ generate_key(seed) }, m_data{ xor_element(buffer[I])... }
-        {}
+        struct cipher_t
+        {
+            TYPE data[count];
+        };
+
+        // only ever called in a constant expression, so the plaintext never reaches the binary
+        static constexpr cipher_t encrypt(const TYPE (&plain)[N + 1])
+        {
+            cipher_t cipher{};
+            for (size_t i = 0; i < count; ++i) {
+                cipher.data[i] = static_cast<TYPE>((i <= N ? plain[i] : TYPE(0)) ^ m_keys.data[i]);
+            }
+            return cipher;
+        }
 
-        constexpr __forceinline const TYPE* get()
+        // constexpr so a static xor_string is constant initialized with the ciphertext
+        XORSTR_FORCEINLINE constexpr explicit xor_string(const cipher_t& cipher)
+            : m_data{}
         {
-            for (size_t i = 0; i < N; ++i) {
-                m_data[i] = xor_element(m_data[i]);
+            for (size_t i = 0; i < count; ++i) {
+                m_data[i] = cipher.data[i];
             }
+        }
 
-            m_data[N] = 0;
-            return const_cast<const TYPE*>(m_data);
+        XORSTR_FORCEINLINE const TYPE* get()
+        {
+            if (m_encrypted) {
+                crypt();
+                m_encrypted = false;
+            }
+            return m_data;
         }
 
     private:
-        constexpr __forceinline TYPE xor_element(TYPE element) const
+        XORSTR_FORCEINLINE void crypt()
         {
-            return element ^ static_cast<const TYPE>(m_key);
+            auto data = reinterpret_cast<unsigned char*>(m_data);
+            auto key = reinterpret_cast<const unsigned char*>(opaque(m_keys.data));
+
+            for (size_t i = 0; i < sizeof(m_data); i += block_size) {
+#if defined(XORSTR_AVX2)
+                auto block = _mm256_load_si256(reinterpret_cast<const __m256i*>(data + i));
+                auto stream = _mm256_load_si256(reinterpret_cast<const __m256i*>(key + i));
+                _mm256_store_si256(reinterpret_cast<__m256i*>(data + i), _mm256_xor_si256(block, stream));
+#elif defined(XORSTR_SSE2)
+                for (size_t j = i; j < i + block_size; j += 16) {
+                    auto block = _mm_load_si128(reinterpret_cast<const __m128i*>(data + j));
+                    auto stream = _mm_load_si128(reinterpret_cast<const __m128i*>(key + j));
+                    _mm_store_si128(reinterpret_cast<__m128i*>(data + j), _mm_xor_si128(block, stream));
+                }
+#else
+                for (size_t j = i; j < i + block_size; ++j) {
+                    data[j] ^= key[j];
+                }
+#endif
+            }
         }
 
-        volatile UINT32 m_key;
-        volatile TYPE m_data[N + 1];
+        alignas(32) TYPE m_data[count];
+        bool m_encrypted = true;
     };
 }
 
-#define XOR(buffer) (utility::xor_string<utility::decay<decltype(*buffer)>, sizeof(buffer) - 1>(buffer, utility::make_index_sequence<sizeof(buffer) - 1>()).get())
\ No newline at end of file
+#define XOR_STRING_TYPE(buffer) \
+    utility::xor_string<utility::decay<decltype(*buffer)>, sizeof(buffer) / sizeof(*buffer) - 1, utility::string_seed(__TIME__, __COUNTER__, __LINE__)>
+
+// Two ways to use a string, pick by how long the plaintext may stay in memory:
+//
+//   XOR("...")         decrypts into a temporary on every execution; the pointer
+//                      and the plaintext only live until the end of the statement
+//   XOR_CACHED("...")  ciphertext sits in static storage and is decrypted in
+//                      place on first use (thread safe through the function local
+//                      static); later executions cost one guard check, and the
+//                      returned pointer stays valid, and plaintext, until exit
+
+#define XOR(buffer) ([]() { \
+    using _xor_string = XOR_STRING_TYPE(buffer); \
+    constexpr auto _cipher = _xor_string::encrypt(buffer); \
+    return _xor_string(_cipher); }().get())
+
+#define XOR_CACHED(buffer) ([]() { \
+    using _xor_string = XOR_STRING_TYPE(buffer); \
+    static _xor_string _cache(_xor_string::encrypt(buffer)); \
+    static const auto _plain = _cache.get(); \
+    return _plain; }())
@@ -1,4 +1,5 @@
 #include "zipper.h"
+#include "../utf8/utf8.hpp"
 #include <algorithm>
 #include <array>
 #include <fstream>
@@ -50,6 +51,76 @@ namespace zipper {
         return crc32(reinterpret_cast<const uint8_t *>(data), size);
     }
 
+    // upper half of IBM code page 437, the zip default when FLAG_UTF8 is clear
+    constexpr uint16_t cp437_high[128] = {
+        0x00C7, 0x00FC, 0x00E9, 0x00E2, 0x00E4, 0x00E0, 0x00E5, 0x00E7,
+        0x00EA, 0x00EB, 0x00E8, 0x00EF, 0x00EE, 0x00EC, 0x00C4, 0x00C5,
+        0x00C9, 0x00E6, 0x00C6, 0x00F4, 0x00F6, 0x00F2, 0x00FB, 0x00F9,
+        0x00FF, 0x00D6, 0x00DC, 0x00A2, 0x00A3, 0x00A5, 0x20A7, 0x0192,
+        0x00E1, 0x00ED, 0x00F3, 0x00FA, 0x00F1, 0x00D1, 0x00AA, 0x00BA,
+        0x00BF, 0x2310, 0x00AC, 0x00BD, 0x00BC, 0x00A1, 0x00AB, 0x00BB,
+        0x2591, 0x2592, 0x2593, 0x2502, 0x2524, 0x2561, 0x2562, 0x2556,
+        0x2555, 0x2563, 0x2551, 0x2557, 0x255D, 0x255C, 0x255B, 0x2510,
+        0x2514, 0x2534, 0x252C, 0x251C, 0x2500, 0x253C, 0x255E, 0x255F,
+        0x255A, 0x2554, 0x2569, 0x2566, 0x2560, 0x2550, 0x256C, 0x2567,
+        0x2568, 0x2564, 0x2565, 0x2559, 0x2558, 0x2552, 0x2553, 0x256B,
+        0x256A, 0x2518, 0x250C, 0x2588, 0x2584, 0x258C, 0x2590, 0x2580,
+        0x03B1, 0x00DF, 0x0393, 0x03C0, 0x03A3, 0x03C3, 0x00B5, 0x03C4,
+        0x03A6, 0x0398, 0x03A9, 0x03B4, 0x221E, 0x03C6, 0x03B5, 0x2229,
+        0x2261, 0x00B1, 0x2265, 0x2264, 0x2320, 0x2321, 0x00F7, 0x2248,
+        0x00B0, 0x2219, 0x00B7, 0x221A, 0x207F, 0x00B2, 0x25A0, 0x00A0,
+    };
+
+    // Names are kept as UTF-8 in memory. With FLAG_UTF8 set they must be
+    // valid UTF-8. Without it the spec says CP437, but many tools write UTF-8
+    // and forget the flag, so valid UTF-8 is kept as is and only the rest is
+    // decoded as CP437. Pure ASCII (the common case) is never touched.
+    bool decode_name(std::string &name, uint16_t bitflags) {
+        if (utf8::is_ascii(name.data(), name.size()))
+            return true;
+
+        if (utf8::validate(name))
+            return true;
+
+        if (bitflags & FLAG_UTF8)
+            return false;
+
+        std::string decoded(name.size() * 3, '\0');
+        size_t size = 0;
+        for (unsigned char c : name) {
+            size += utf8::encode(c < 0x80 ? c : cp437_high[c - 0x80], &decoded[size]);
+        }
+        decoded.resize(size);
+        name.swap(decoded);
+        return true;
+    }
+
+    // FLAG_UTF8 is set only when it means something: names that are not
+    // plain ASCII, and only when they really are UTF-8 (raw bytes added by
+    // the caller are written unflagged)
+    uint16_t name_flags(const ZipFile &file) {
+        auto flags = static_cast<uint16_t>(file.bitflags & ~FLAG_UTF8);
+        auto ascii = utf8::is_ascii(file.file_name.data(), file.file_name.size()) &&
+                     utf8::is_ascii(file.comment.data(), file.comment.size());
+        if (!ascii && utf8::validate(file.file_name) && utf8::validate(file.comment))
+            flags |= FLAG_UTF8;
+        return flags;
+    }
+
+    // Windows narrow paths go through the ANSI code page, so UTF-8 names are
+    // opened through their UTF-16 form instead
+    template <typename Stream>
+    void open_utf8(Stream &stream, const std::string &file_name, std::ios::openmode mode) {
+#if defined(_WIN32)
+        std::wstring wide;
+        if (utf8::to_utf16(file_name, wide)) {
+            stream.open(wide.c_str(), mode);
+            return;
+        }
+#endif
+        stream.open(file_name, mode);
+    }
+
     class ifstream_t : public std::ifstream {
     private:
         size_t _size;
@@ -59,7 +130,7 @@ namespace zipper {
         ifstream_t(bool use_reverse = false) : _use_reverse(use_reverse) {};
 
         bool try_open(const std::string &file_name) {
-            open(file_name, std::ios::in | std::ios::binary);
+            open_utf8(*this, file_name, std::ios::in | std::ios::binary);
 
             if (good()) {
                 seekg(0, std::ios::end);
@@ -105,7 +176,7 @@ namespace zipper {
         ofstream_t(bool auto_reverse = false) : _use_reverse(auto_reverse) {};
 
         bool try_open(const std::string &file_name) {
-            open(file_name, std::ios::out | std::ios::binary | std::ios::trunc);
+            open_utf8(*this, file_name, std::ios::out | std::ios::binary | std::ios::trunc);
             return good();
         }
 
@@ -219,6 +290,12 @@ namespace zipper {
         out.write(file.internal_attributes);
         out.write(file.external_attributes);
         out.write(file_offset);
+        if (file.file_name.size())
+            out.write_buf(file.file_name.data(), file.file_name.size());
+        if (file.extra_fields.size())
+            out.write_buf(file.extra_fields.data(), file.extra_fields.size());
+        if (file.comment.size())
+            out.write_buf(file.comment.data(), file.comment.size());
     }
 
     size_t find_eocd(ifstream_t &in) {
@@ -246,6 +323,9 @@ namespace zipper {
 
         uint32_t directory_count = 0;
         uint32_t file_count = 0;
+        auto comment = _comment;
+        // filled aside and merged on success, a failed load leaves the zipper as it was
+        decltype(_files) files;
 
         if (!in.try_open(file_name)) {
             return Error::FileError;
@@ -264,7 +344,7 @@ namespace zipper {
         auto eocd = read_eocd(in);
 
         if (eocd.comment_length > 0) {
-            _comment = in.read_str(eocd.comment_length);
+            comment = in.read_str(eocd.comment_length);
         }
 
         auto count = eocd.directory_total_entires;
@@ -290,6 +370,10 @@ namespace zipper {
                 file.comment = in.read_str(cdfh.comment_length);
             }
 
+            if (!decode_name(file.file_name, cdfh.bitflags) || !decode_name(file.comment, cdfh.bitflags)) {
+                return Error::InvalidName;
+            }
+
             size_t next = in.tellg();
 
             in.seekg(cdfh.file_offset, in.beg);
@@ -316,11 +400,14 @@ namespace zipper {
             file.internal_attributes = cdfh.internal_attributes;
             file.external_attributes = cdfh.external_attributes;
 
-            _files.emplace(file.file_name, file);
+            auto name = file.file_name;
+            files.emplace(std::move(name), std::move(file));
 
             in.seekg(next, in.beg);
         }
 
+        _files.merge(files);
+        _comment = std::move(comment);
         _directory_count = directory_count;
         _file_count = file_count;
 
@@ -338,6 +425,7 @@ namespace zipper {
         std::vector<uint32_t> offsets;
 
         for (auto &f : _files) {
+            f.second.bitflags = name_flags(f.second);
             files.push_back(&(f.second));
             offsets.push_back(out.tellp());
             write_fh(out, f.second);
@@ -359,7 +447,7 @@ namespace zipper {
         out.write<uint16_t>(files.size());
         out.write(cdfh_size);
         out.write(cdfh_offset);
-        out.write(_comment.size());
+        out.write<uint16_t>(_comment.size());
         if (_comment.size())
             out.write_buf(_comment.data(), _comment.size());
 
@@ -367,6 +455,10 @@ namespace zipper {
     }
 
     void Zipper::add(const std::string &file_name, const std::vector<uint8_t> &data) {
+        add(file_name, std::vector<uint8_t>(data));
+    }
+
+    void Zipper::add(const std::string &file_name, std::vector<uint8_t> &&data) {
         ZipFile file;
 
         file.version_made = VERSION_STORE;
@@ -382,9 +474,9 @@ namespace zipper {
         file.external_attributes = 32;
 
         file.file_name = file_name;
-        file.data = data;
+        file.data = std::move(data);
 
-        _files.emplace(file_name, file);
+        _files.emplace(file_name, std::move(file));
     }
 
     void Zipper::add(const std::string &file_name, const std::string &str) {
@@ -393,6 +485,14 @@ namespace zipper {
         add(file_name, data);
     }
 
+    const std::vector<uint8_t> *Zipper::data(const std::string &file_name) {
+        auto it = _files.find(file_name);
+        if (it == _files.end() || it->second.compression_method != METHOD_STORE) {
+            return nullptr;
+        }
+        return &it->second.data;
+    }
+
     void Zipper::remove(const std::string &file_name) {
         _files.erase(file_name);
     }
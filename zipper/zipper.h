@@ -22,13 +22,17 @@ namespace zipper {
     constexpr uint16_t DATE_NORMAL = 0x21;
     constexpr uint16_t TIME_NORMAL = 0x00;
 
+    // GeneralPurposeBitFlags::utf8, name and comment are UTF-8 instead of CP437
+    constexpr uint16_t FLAG_UTF8 = 0x0800;
+
     enum class Error {
         Success,
         FileError,
         InvalidFile,
         InvalidSize,
         InvalidSignature,
-        UnsupportMethod
+        UnsupportMethod,
+        InvalidName
     };
 
     union Date {
@@ -133,7 +137,7 @@ namespace zipper {
 
         std::vector<uint8_t> data;
         std::vector<uint8_t> extra_fields;
-        std::string file_name;
+        std::string file_name; // always UTF-8 in memory, see Zipper::load / save
         std::string comment;
     };
 
@@ -146,6 +150,11 @@ namespace zipper {
         Error save(const std::string &file_name);
 
         void add(const std::string &file_name, const std::vector<uint8_t>& data);
+
+        void add(const std::string &file_name, std::vector<uint8_t>&& data);
+
+        // contents of a stored entry, nullptr when missing or compressed
+        const std::vector<uint8_t> *data(const std::string &file_name);
         
         void add(const std::string &file_name, const std::string& str);
         